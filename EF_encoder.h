@@ -9,167 +9,390 @@
 // DATE:        4/18/2019
 
 #include <vector>
-#include <bitset>
-#include <math.h>
+#include <stdint.h>
+#include <string.h>
 #include <iostream>
 #include <unordered_map>
 #include <string>
+#include <string_view>
+#include "arena.h"
+#include "stats.h"
 
 using std::vector;
-using std::bitset;
 using std::cout;
 using std::unordered_map;
-using std::string;
+using std::string; using std::string_view;
 
-const int bits = 64; // used for bitsets
+const int bits = 64; // word size of the bit arrays
 
 size_t SIZE_TRACKER = 0; // Keeps track of memory storage used by trie
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// LOWER BIT KERNELS
+//
+// lower bits are stored back to back, W bits per element, so unpacking a run
+// of them is the same shift and mask for every element. Having one kernel per
+// width lets the compiler use constant shifts and unroll/vectorize the loop,
+// the Encoder picks the right one once when it is built
+
+template <typename T>
+struct LowerBitKernel {
+  typedef void (*type)(const uint64_t*, size_t, size_t, T*);
+};
+
+////////////////////////////////////////
+// writes the lower bits of elements [from, from + count) to out
+template <typename T, int W>
+void unpackLowerBits(const uint64_t* words, size_t from, size_t count, T* out)
+{
+  const uint64_t mask = W == 0 ? 0 : (~uint64_t(0) >> (bits - W - (W == 0)));
+  for (size_t i = 0; i != count; ++i)
+    {
+      const size_t bit = (from + i) * W;
+      const size_t word = bit / bits, offset = bit % bits;
+
+      // words has one word of padding so reading word + 1 is always safe
+      uint64_t value = words[word] >> offset;
+      if (offset + W > bits)
+	value |= (words[word + 1] << 1) << (bits - offset - 1);
+
+      out[i] = static_cast<T>(value & mask);
+    }
+}
+
+////////////////////////////////////////
+// fills table[0..W] with the kernels for each width
+template <typename T, int W>
+struct LowerBitKernelTable {
+  static void fill(typename LowerBitKernel<T>::type *table)
+  {
+    table[W] = &unpackLowerBits<T, W>;
+    LowerBitKernelTable<T, W - 1>::fill(table);
+  }
+};
+
+template <typename T>
+struct LowerBitKernelTable<T, -1> {
+  static void fill(typename LowerBitKernel<T>::type*) {}
+};
+
+////////////////////////////////////////
+// dispatcher, returns the kernel specialized for width lower bits
+template <typename T>
+typename LowerBitKernel<T>::type lowerBitKernel(const int& width)
+{
+  struct Table {
+    Table() { LowerBitKernelTable<T, sizeof(T) * 8 - 1>::fill(kernels); }
+    typename LowerBitKernel<T>::type kernels[sizeof(T) * 8];
+  };
+  static const Table table;
+
+  return table.kernels[width];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// ENCODER BASE
+//
+// holds what is shared by every Encoder specialization
+
+class EncoderBase : public ArenaObject {
+public:
+  // vocabulary of grams and IDs
+  // assigned in main file by EncoderBase::vocab_ = map
+  static unordered_map<string, size_t> *vocabS2ID_;
+  static vector<string_view> *vocabWords_; // indexed by ID, viewing the
+                                           // words held by vocabS2ID_
+
+  // lookups that never add to the vocab or copy a word. wordID is 0, which
+  // is never an ID, for a word that isn't in the vocab
+  static size_t      wordID (const string&);
+  static string_view word   (const size_t& ID) { return (*vocabWords_)[ID]; }
+};
+
+unordered_map<string, size_t>* EncoderBase::vocabS2ID_ = nullptr;
+vector<string_view>* EncoderBase::vocabWords_ = nullptr;
+
+////////////////////////////////////////
+size_t EncoderBase::wordID(const string& word)
+{
+  COUNT_STAT(vocabLookups, 1);
+  const auto found = vocabS2ID_->find(word);
+  return found == vocabS2ID_->end() ? 0 : found->second;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // ENCODER
+//
+// T is the type of the encoded values, uint32_t for gram IDs and size_t for
+// offsets. The number of lower bits depends on the sequence, so it is chosen
+// when the Encoder is built along with the kernel that unpacks them
 
-class Encoder {
+template <typename T = size_t>
+class Encoder : public EncoderBase {
 public:
+  typedef T value_type;
+
   // constructor
-  Encoder(vector<size_t>);
+  template <typename U>
+  Encoder(const vector<U>&);
   ~Encoder();
 
+  Encoder(const Encoder&) = delete;
+  Encoder& operator=(const Encoder&) = delete;
+
   // methods
-  size_t access        (const size_t&) const; // access to i-th element
+  T      access        (const size_t&) const; // access to i-th element
+  void   decode        (T*, const size_t&, const size_t&) const;
+                                              // sequential decode of a range
   size_t size          ()              const { return size_; }
   void   printSequence ()              const; // for testing
 
-  // vocabulary of grams and IDs
-  // assigned in main file by Encoder::vocab_ = map
-  static unordered_map<string, size_t> *vocabS2ID_;
-  static unordered_map<size_t, string> *vocabID2S_;
-
 private:
-  vector<bool> bitSequence_;
-  int maxBits_;     // bits needed for largest number
-  size_t size_;     // how many elements there are
-  int lowerBitNum_; // number of lower bits
-};
+  T      lower  (const size_t&) const; // lower bits of the i-th element
+  size_t select (size_t)        const; // position of the i-th 1 in upper bits
 
-unordered_map<string, size_t>* Encoder::vocabS2ID_ = nullptr;
-unordered_map<size_t, string>* Encoder::vocabID2S_ = nullptr;
+  uint64_t *words_;        // lower bits of every element, then upper bits
+  size_t wordNum_;         // words allocated for words_
+  size_t size_;            // how many elements there are
+  size_t upperStart_;      // bit position where the upper bits start
+  int lowerBitNum_;        // number of lower bits
+  typename LowerBitKernel<T>::type unpack_; // kernel for lowerBitNum_
+};
 
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Member functions
 ////////////////////////////////////////
-// sequence MUST be non-decreasing and longer than 1 and use nums greater than 2
-Encoder::Encoder(vector<size_t> sequence)
+// sequence MUST be non-decreasing, U can be any unsigned type that fits in T
+// so callers don't have to copy the sequence to narrow it
+template <typename T>
+template <typename U>
+Encoder<T>::Encoder(const vector<U>& sequence)
+: words_(nullptr), wordNum_(0), size_(sequence.size()), upperStart_(0),
+  lowerBitNum_(0), unpack_(nullptr)
 {
-  // convert sequence of size_t to bits with size ceiling(log2(max(sequence)))
+  if (size_ == 0)
+    return;
+
+  // lower bits are floor(log2(universe / n)), the rest are stored in unary
   // since the sequence is sorted back should contain the largest element
-  maxBits_ = ceil(log2(sequence.back())) + 1; // m or the universe
-  size_ = sequence.size(); // n
-  vector<bitset<bits>> bitRepSequence;
+  const uint64_t universe = sequence.back();
+  if (universe / size_ > 0)
+    lowerBitNum_ = bits - 1 - __builtin_clzll(universe / size_);
+  unpack_ = lowerBitKernel<T>(lowerBitNum_);
 
-  // converting
-  for (size_t i = 0; i != size_; ++i)
-    bitRepSequence.push_back(bitset<bits>(sequence[i]));
+  // n * lowerBitNum_ lower bits, then n 1s and (universe >> lowerBitNum_) 0s
+  // for the upper bits, plus one word of padding so kernels can always read
+  // the next word. Words come from the current Arena when there is one
+  upperStart_ = size_ * lowerBitNum_;
+  wordNum_ = (upperStart_ + size_ + (universe >> lowerBitNum_)) / bits + 2;
+  words_ = static_cast<uint64_t*>(arenaNew(wordNum_ * sizeof(uint64_t)));
+  memset(words_, 0, wordNum_ * sizeof(uint64_t));
 
-  // if it is just a single number, store it as binary without encoding
-  if (size_ == 1)
+  // single pass, each element writes its lower bits into at most two words
+  // and sets one bit in the upper bits
+  const uint64_t mask = lowerBitNum_ == 0 ? 0 :
+    ~uint64_t(0) >> (bits - lowerBitNum_);
+  uint64_t *words = words_;
+  for (size_t i = 0; i != size_; ++i)
     {
-      for (size_t i = 0; i != bitRepSequence[0].size(); ++i)
-	bitSequence_.push_back(bitRepSequence[0][i]);
-      return;
+      const uint64_t value = sequence[i];
+
+      if (lowerBitNum_ != 0)
+	{
+	  const size_t bit = i * lowerBitNum_;
+	  const size_t word = bit / bits, offset = bit % bits;
+	  words[word] |= (value & mask) << offset;
+	  if (offset + lowerBitNum_ > bits)
+	    words[word + 1] |= (value & mask) >> (bits - offset);
+	}
+
+      const size_t upper = upperStart_ + (value >> lowerBitNum_) + i;
+      words[upper / bits] |= uint64_t(1) << (upper % bits);
     }
 
-  lowerBitNum_ = ceil(log2(sequence.back()/sequence.size()));
-  const size_t highBitNum = maxBits_ - lowerBitNum_;
+  // Add memory used
+  SIZE_TRACKER += sizeof(*this) + wordNum_ * sizeof(uint64_t);
+}
 
-  // create the bit sequence that will be returned
-  // add the lower bits concatenated to the begining of the bitSequence
-  lowerBitNum_ = maxBits_ - highBitNum;
-  for (size_t i = 0; i != size_; ++i)
-    for (size_t j = 0; j != lowerBitNum_; ++j)
-      {
-	bitSequence_.push_back(bitRepSequence[size_ - i - 1][j]);
-	bitRepSequence[size_ - i - 1][j] = 0; // to get just the size of the upper bits
-      }
-  
-  // create buckets to store high bit occurences
-  vector<size_t> highBitBuckets(pow(2, highBitNum), 0);
-
-  // getting high bit occuerences
-  for (size_t i = 0; i != size_; ++i)
-    {
-      size_t num = bitRepSequence[i].to_ullong();
-      
-      // divide num by 2 for the amount of lowerBits
-      for (size_t j = 0; j != lowerBitNum_; ++j)
-	num = floor(num / 2);
+////////////////////////////////////////
+template <typename T>
+Encoder<T>::~Encoder()
+{
+  if (words_ == nullptr)
+    return;
 
-      ++highBitBuckets[num]; 
-    }
+  SIZE_TRACKER -= sizeof(*this) + wordNum_ * sizeof(uint64_t);
+  arenaDelete(words_);
+}
+
+////////////////////////////////////////
+template <typename T>
+T Encoder<T>::lower(const size_t& rank) const
+{
+  if (lowerBitNum_ == 0)
+    return 0;
+
+  const size_t bit = rank * lowerBitNum_;
+  const size_t word = bit / bits, offset = bit % bits;
+
+  uint64_t value = words_[word] >> offset;
+  if (offset + lowerBitNum_ > bits)
+    value |= (words_[word + 1] << 1) << (bits - offset - 1);
+
+  return static_cast<T>(value & (~uint64_t(0) >> (bits - lowerBitNum_)));
+}
 
-  // now finish the bit sequence
-  size_t HBBsize = highBitBuckets.size();
-  for (size_t i = 0; i != HBBsize; ++i)
+////////////////////////////////////////
+// finds the position of the rank-th 1 in the upper bits, relative to the
+// start of the upper bits
+template <typename T>
+size_t Encoder<T>::select(size_t rank) const
+{
+  size_t word = upperStart_ / bits;
+  uint64_t current = words_[word] & (~uint64_t(0) << (upperStart_ % bits));
+  size_t ones = __builtin_popcountll(current);
+  COUNT_STAT(selects, 1);
+  COUNT_STAT(bitsScanned, bits - upperStart_ % bits);
+  while (rank >= ones)
     {
-      bitSequence_.push_back(0);
-      for (size_t j = 0; j != highBitBuckets[i]; ++j)
-	bitSequence_.push_back(1);
+      rank -= ones;
+      current = words_[++word];
+      ones = __builtin_popcountll(current);
+      COUNT_STAT(bitsScanned, bits);
     }
 
-  // Add memory used
-  SIZE_TRACKER += sizeof(*this);
+  // clear the lower 1s in this word until the one we want is the lowest
+  for (; rank != 0; --rank)
+    current &= current - 1;
+
+  return word * bits + __builtin_ctzll(current) - upperStart_;
 }
 
 ////////////////////////////////////////
-Encoder::~Encoder()
+template <typename T>
+T Encoder<T>::access(const size_t& rank) const
 {
-  SIZE_TRACKER -= sizeof(*this);
+  // the high part is how many 0s are before the rank-th 1
+  const T highNum = static_cast<T>(select(rank) - rank);
+
+  return (highNum << lowerBitNum_) | lower(rank);
 }
 
 ////////////////////////////////////////
-size_t Encoder::access(const size_t& rank) const
+// writes elements [from, from + count) to out, this is much faster than
+// calling access for each element since the upper bits are only searched once
+template <typename T>
+void Encoder<T>::decode(T* out, const size_t& from,
+			 const size_t& count) const
 {
-  // get lower bits
-  bitset<bits> binaryElement;
+  if (count == 0)
+    return;
+
+  // lower bits
+  unpack_(words_, from, count, out);
 
-  // check if it was a size of 1, then just convert to size_t
-  if (size_ == 1)
+  // upper bits, walk the 1s starting at the from-th one
+  const size_t start = select(from) + upperStart_;
+  size_t word = start / bits;
+  uint64_t current = words_[word] & (~uint64_t(0) << (start % bits));
+  for (size_t i = 0; i != count; ++i)
     {
-      for (size_t i = 0; i != bitSequence_.size(); ++i)
-	binaryElement[i] = bitSequence_[i];
-      return binaryElement.to_ullong();
+      while (current == 0)
+	current = words_[++word];
+
+      const size_t pos = word * bits + __builtin_ctzll(current) - upperStart_;
+      current &= current - 1;
+
+      out[i] |= static_cast<T>(pos - from - i) << lowerBitNum_;
     }
+}
 
-  // the range for the lower bits is 
-  // [(size_ - rank - 1) * lowerBitNum + 1, size_ - rank * lowerBitNum]
-  for (int i = 0; i != lowerBitNum_; ++i)
-    binaryElement[i] = bitSequence_[(size_ - rank - 1) * lowerBitNum_ + i];
+////////////////////////////////////////
+template <typename T>
+void Encoder<T>::printSequence() const
+{
+  const size_t total = upperStart_ + size_ +
+    (size_ == 0 ? 0 : (access(size_ - 1) >> lowerBitNum_) + 1);
+  for (size_t i = 0; i != total; ++i)
+    cout << ((words_[(total - i - 1) / bits] >> ((total - i - 1) % bits)) & 1);
+  cout << '\n';
+}
 
-  // get high bits
-  // find the position of the i-th 1 from the right, after the lower bits
-  int pos = 0;
-  for (int count = 0; count != rank + 1; ++pos)
-    if (bitSequence_[lowerBitNum_ * size_ + pos] == 1)
-      ++count;
+////////////////////////////////////////////////////////////////////////////////
+//
+// PACKED ARRAY
+//
+// fixed width values packed back to back, for values with no order for EF to
+// take advantage of like frequencies in lexicographic order
+
+class PackedArray : public ArenaObject {
+public:
+  PackedArray(const vector<uint64_t>&, const int&); // values, bits per value
+  ~PackedArray();
+
+  PackedArray(const PackedArray&) = delete;
+  PackedArray& operator=(const PackedArray&) = delete;
+
+  // methods
+  uint64_t get   (const size_t&) const;
+  size_t   size  ()              const { return size_; }
+  int      width ()              const { return width_; }
+
+private:
+  uint64_t *words_;
+  size_t wordNum_;
+  size_t size_;
+  int width_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// PACKED ARRAY member functions
+////////////////////////////////////////
+// values MUST fit in width bits, width is at most 64
+PackedArray::PackedArray(const vector<uint64_t>& values, const int& width)
+: size_(values.size()), width_(width)
+{
+  // plus one word of padding so get can always read the next word
+  wordNum_ = (size_ * width_) / bits + 2;
+  words_ = static_cast<uint64_t*>(arenaNew(wordNum_ * sizeof(uint64_t)));
+  memset(words_, 0, wordNum_ * sizeof(uint64_t));
 
-  size_t highNum = pos - rank - 2; // - 2 for the extra pos after the count is found
-                                   // and finding 1 extra rank
-  bitset<bits> highBits(highNum);
+  for (size_t i = 0; i != size_; ++i)
+    {
+      const size_t bit = i * width_;
+      const size_t word = bit / bits, offset = bit % bits;
+      words_[word] |= values[i] << offset;
+      if (offset + width_ > bits)
+	words_[word + 1] |= values[i] >> (bits - offset);
+    }
 
-  // append the highBits to the end of the low ones
-  for (int i = 0; i < maxBits_ - lowerBitNum_; ++i)
-    binaryElement[lowerBitNum_ + i] = highBits[i];
+  // Add memory used
+  SIZE_TRACKER += sizeof(*this) + wordNum_ * sizeof(uint64_t);
+}
 
-  return binaryElement.to_ullong();
+////////////////////////////////////////
+PackedArray::~PackedArray()
+{
+  SIZE_TRACKER -= sizeof(*this) + wordNum_ * sizeof(uint64_t);
+  arenaDelete(words_);
 }
 
 ////////////////////////////////////////
-void Encoder::printSequence() const
+uint64_t PackedArray::get(const size_t& index) const
 {
-  for (size_t i = 0; i != bitSequence_.size(); ++i)
-    cout << bitSequence_[bitSequence_.size() - i - 1];
-  cout << '\n';
+  const size_t bit = index * width_;
+  const size_t word = bit / bits, offset = bit % bits;
+
+  uint64_t value = words_[word] >> offset;
+  if (offset + width_ > bits)
+    value |= (words_[word + 1] << 1) << (bits - offset - 1);
+
+  return value & (~uint64_t(0) >> (bits - width_));
 }
 
 #endif // ENCODER_H
@@ -0,0 +1,124 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// FILE:        arena.h
+// DESCRIPTION: bump allocator used to place nodes and their bit arrays
+//              next to each other in memory
+// AUTHOR:      Dan Fabian and Lauren Greathouse
+// DATE:        10/18/2026
+
+#include <vector>
+#include <new>
+#include <cstddef>
+
+using std::vector;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// ARENA
+//
+// hands out memory in the order it is asked for, so anything allocated one
+// after the other ends up next to each other. Memory is only given back when
+// the whole arena is deleted
+
+class Arena {
+public:
+  Arena(const size_t& blockBytes = 1 << 20)
+    : next_(nullptr), left_(0), blockBytes_(blockBytes), bytes_(0) {}
+  ~Arena();
+
+  // methods
+  void*  allocate (size_t);
+  size_t bytes    () const { return bytes_; } // total reserved
+
+  // while set, ArenaObjects and Encoder bit arrays are allocated here
+  static Arena *current_;
+
+private:
+  vector<char*> blocks_;
+  char *next_;
+  size_t left_;
+  size_t blockBytes_;
+  size_t bytes_;
+};
+
+Arena* Arena::current_ = nullptr;
+
+////////////////////////////////////////
+Arena::~Arena()
+{
+  for (size_t i = 0; i != blocks_.size(); ++i)
+    delete [] blocks_[i];
+}
+
+////////////////////////////////////////
+void* Arena::allocate(size_t size)
+{
+  // keep everything 8 byte aligned
+  size = (size + 7) & ~size_t(7);
+
+  if (size > left_)
+    {
+      const size_t blockSize = size > blockBytes_ ? size : blockBytes_;
+      blocks_.push_back(new char[blockSize]);
+      next_ = blocks_.back();
+      left_ = blockSize;
+      bytes_ += blockSize;
+    }
+
+  void *result = next_;
+  next_ += size;
+  left_ -= size;
+  return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// tagged allocation, every allocation has a word in front of it saying if it
+// came from an arena so deleting it doesn't need to know where it came from
+////////////////////////////////////////
+void* arenaNew(const size_t& size)
+{
+  size_t *block;
+  if (Arena::current_ != nullptr)
+    {
+      block = static_cast<size_t*>
+	(Arena::current_->allocate(size + sizeof(size_t)));
+      *block = 1;
+    }
+  else
+    {
+      block = static_cast<size_t*>(::operator new(size + sizeof(size_t)));
+      *block = 0;
+    }
+
+  return block + 1;
+}
+
+////////////////////////////////////////
+void arenaDelete(void* ptr)
+{
+  if (ptr == nullptr)
+    return;
+
+  // arena memory is freed with the arena
+  size_t *block = static_cast<size_t*>(ptr) - 1;
+  if (*block == 0)
+    ::operator delete(block);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// ARENA OBJECT
+//
+// classes deriving from this are allocated from Arena::current_ when set
+
+class ArenaObject {
+public:
+  static void* operator new    (size_t size) { return arenaNew(size); }
+  static void  operator delete (void* ptr)   { arenaDelete(ptr); }
+};
+
+#endif // ARENA_H
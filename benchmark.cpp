@@ -0,0 +1,261 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// FILE:        benchmark.cpp
+// DESCRIPTION: times queries on the trie for each node layout
+// AUTHOR:      Dan Fabian and Lauren Greathouse
+// DATE:        10/18/2026
+
+#include "trie.h"
+#include "vocab.h"
+#include "perf.h"
+#include <iostream>
+#include <sstream>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+using std::cout; using std::stoul; using std::stod; using std::stoi;
+using std::stringstream; using std::getline;
+
+// used for timing queries
+typedef std::chrono::high_resolution_clock Clock;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// QUERIES
+
+struct Query {
+  vector<string> tokens;
+  bool next; // mostLikelyNext if true, frequencyCount otherwise
+};
+
+////////////////////////////////////////
+// every gram in the file and its count, false if the file couldn't all be
+// read
+bool loadGrams(const char* fileName, const int& gramLen, 
+	       const GramFormat& format, vector<vector<string>>& grams, 
+	       vector<size_t>& counts)
+{
+  GramReader reader(fileName, gramLen, format);
+  vector<string> gram;
+  size_t count;
+  while (reader.next(gram, count))
+    {
+      grams.push_back(gram);
+      counts.push_back(count);
+    }
+
+  return !reader.failed();
+}
+
+////////////////////////////////////////
+// picks grams weighted by their count, so frequent grams are queried more
+// like they would be by a real user. Half of the queries are mostLikelyNext
+// on a prefix of the gram, half are frequencyCount on all of it
+vector<Query> makeQueries(const vector<vector<string>>& grams,
+			  const vector<size_t>& counts, const size_t& num)
+{
+  std::mt19937_64 rng(5); // fixed seed so every layout gets the same queries
+  std::discrete_distribution<size_t> pickLine(counts.begin(), counts.end());
+  vector<Query> queries(num);
+  for (size_t i = 0; i != num; ++i)
+    {
+      queries[i].tokens = grams[pickLine(rng)];
+      queries[i].next = i % 2 == 0;
+
+      // unigrams are their own context
+      const int length = queries[i].tokens.size();
+      if (queries[i].next && length > 1)
+	queries[i].tokens.resize
+	  (std::uniform_int_distribution<int>(1, length - 1)(rng));
+    }
+
+  return queries;
+}
+
+////////////////////////////////////////
+// runs only the mostLikelyNext queries, or only the frequencyCount ones, and
+// prints hardware events per query for them if perf_event_open works, and
+// the hot path counters if they were compiled in with -DNGRAM_STATS
+void profileClass(const Trie& t, const vector<Query>& queries, 
+		  const bool& next)
+{
+  PerfCounter *events[PERF_EVENT_COUNT];
+  for (int e = 0; e != PERF_EVENT_COUNT; ++e)
+    events[e] = new PerfCounter(static_cast<PerfEvent>(e));
+
+  QUERY_STATS.reset();
+  Successor results[5];
+  size_t num = 0, checksum = 0;
+  for (int e = 0; e != PERF_EVENT_COUNT; ++e)
+    events[e]->start();
+  for (size_t i = 0; i != queries.size(); ++i)
+    if (queries[i].next == next)
+      {
+	++num;
+	if (next)
+	  checksum += t.mostLikelyNext(queries[i].tokens, 5, results);
+	else
+	  checksum += t.frequencyCount(queries[i].tokens);
+      }
+  uint64_t counts[PERF_EVENT_COUNT];
+  for (int e = 0; e != PERF_EVENT_COUNT; ++e)
+    counts[e] = events[e]->stop();
+
+  cout << "  " << (next ? "mostLikelyNext" : "frequencyCount") << ":";
+  for (int e = 0; e != PERF_EVENT_COUNT; ++e)
+    if (events[e]->valid() && num != 0)
+      cout << ' ' << PERF_EVENT_NAMES[e] << "/query " 
+	   << double(counts[e]) / num << ',';
+  cout << " (" << checksum << ")\n";
+#ifdef NGRAM_STATS
+  cout << "    ";
+  QUERY_STATS.print(cout);
+#endif
+
+  for (int e = 0; e != PERF_EVENT_COUNT; ++e)
+    delete events[e];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// MAIN
+
+int main(int argc, char *argv[])
+{
+  if (argc < 4)
+    {
+      cout << "Need data input file, plain, gzip or zstd, length of grams "
+	   << "and K\n"
+	   << "optionally the number of queries, a layout (or all), the share\n"
+	   << "of frequency each node's top K should cover, the minimum count\n"
+	   << "of each order, the most successors a node keeps, the entropy\n"
+	   << "pruning threshold, dedup to share identical successors and\n"
+	   << "the file format: counts, arpa or google\n"
+	   << "example ./benchmark file.txt 5 3 1000000 hot 0.9 1,1,2 100 "
+	   << "1e-7 dedup counts\n";
+      return 1;
+    }
+
+  const int gramSize = stoi(argv[2]);
+  const GramFormat format = argc > 11 ? formatFromName(argv[11]) 
+	                              : FORMAT_COUNTS;
+  GramReader vocabReader(argv[1], gramSize, format);
+  if (!vocabReader.good())
+    {
+      cout << "Could not open file, exiting\n";
+      return 1;
+    }
+
+  const int k = stoi(argv[3]);
+  const size_t queryNum = argc > 4 ? stoul(argv[4]) : 1000000;
+
+  // layouts to compare, all of them unless one was given
+  vector<Layout> layouts;
+  if (argc > 5 && string(argv[5]) != "all")
+    layouts.push_back(layoutFromName(argv[5]));
+  else
+    for (int i = 0; i != LAYOUT_COUNT; ++i)
+      layouts.push_back(static_cast<Layout>(i));
+
+  // create vocab, needed to construct the trie
+  Vocab v(vocabReader);
+  if (vocabReader.failed())
+    {
+      cout << "Could not read all of the file, exiting\n";
+      return 1;
+    }
+  EncoderBase::vocabS2ID_ = &v.vocabS2ID;
+  EncoderBase::vocabWords_ = &v.vocabWords;
+
+  vector<vector<string>> grams;
+  vector<size_t> counts;
+  if (!loadGrams(argv[1], gramSize, format, grams, counts))
+    {
+      cout << "Could not read all of the file, exiting\n";
+      return 1;
+    }
+  vector<Query> queries = makeQueries(grams, counts, queryNum);
+
+  PerfCounter cacheMisses(PERF_CACHE_MISSES);
+  if (!cacheMisses.valid())
+    cout << "perf_event_open not available, cache misses not reported\n";
+
+  cout << "layout\tbuild ms\tbytes\tbytes/gram\tarena bytes\tns/query\t"
+       << "misses/query\n";
+  for (size_t l = 0; l != layouts.size(); ++l)
+    {
+      TrieOptions options;
+      options.layout = layouts[l];
+      if (argc > 6)
+	options.topKCoverage = stod(argv[6]);
+      if (argc > 7)
+	{
+	  stringstream counts(argv[7]);
+	  string count;
+	  while (getline(counts, count, ','))
+	    options.minCount.push_back(stoul(count));
+	}
+      if (argc > 8)
+	options.maxSuccessors = stoul(argv[8]);
+      if (argc > 9)
+	options.entropyThreshold = stod(argv[9]);
+      if (argc > 10)
+	options.dedup = string(argv[10]) == "dedup";
+
+      // build time includes reading the file, each build reads it again
+      const size_t sizeBefore = SIZE_TRACKER;
+      auto b1 = Clock::now();
+      GramReader reader(argv[1], gramSize, format);
+      Trie t(reader, k, options);
+      auto b2 = Clock::now();
+      if (reader.failed())
+	{
+	  cout << "Could not read all of the file, exiting\n";
+	  return 1;
+	}
+
+      // results are summed so the queries can't be optimized away. The
+      // Successor versions of mostLikelyNext don't copy words, like a
+      // server answering with IDs
+      Successor results[5];
+      size_t checksum = 0;
+      cacheMisses.start();
+      auto t1 = Clock::now();
+      for (size_t i = 0; i != queries.size(); ++i)
+	if (queries[i].next)
+	  checksum += t.mostLikelyNext(queries[i].tokens, 5, results);
+	else
+	  checksum += t.frequencyCount(queries[i].tokens);
+      auto t2 = Clock::now();
+      const uint64_t misses = cacheMisses.stop();
+
+      cout << LAYOUT_NAMES[layouts[l]] << '\t'
+	   << std::chrono::duration_cast<std::chrono::milliseconds>(b2 - b1).count()
+	   << '\t' << SIZE_TRACKER - sizeBefore << '\t'
+	   << double(SIZE_TRACKER - sizeBefore) / grams.size() << '\t'
+	   << t.arenaBytes() << '\t'
+	   << std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count()
+	      / queries.size() << '\t';
+      if (cacheMisses.valid())
+	cout << double(misses) / queries.size();
+      else
+	cout << "n/a";
+      cout << "\t(" << checksum << ")\n";
+
+      const BuildStats& stats = t.buildStats();
+      if (stats.dropped != 0)
+	cout << "  pruning dropped " << stats.dropped << " grams, "
+	     << "at least " << stats.droppedBytes << " bytes\n";
+      if (options.dedup)
+	cout << "  dedup shared " << stats.shared << " of " 
+	     << stats.successorSets << " successor sets, freeing " 
+	     << stats.sharedBytes << " bytes, ratio " 
+	     << double(SIZE_TRACKER - sizeBefore + stats.sharedBytes) /
+	        (SIZE_TRACKER - sizeBefore) << '\n';
+
+      profileClass(t, queries, true);
+      profileClass(t, queries, false);
+    }
+}
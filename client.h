@@ -0,0 +1,176 @@
+#ifndef CLIENT_H
+#define CLIENT_H
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// FILE:        client.h
+// DESCRIPTION: client of the shard servers, sends each query to the shard of
+//              its first word
+// AUTHOR:      Dan Fabian and Lauren Greathouse
+// DATE:        10/18/2026
+
+#include <string>
+#include <vector>
+#include "shard.h"
+
+using std::string;
+using std::vector;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// SHARD CLIENT
+//
+// holds a connection to every shard. run sends each shard one batch with all
+// of its queries before reading any answers, so the shards work on them at
+// the same time. Not safe to share between threads, use one per thread
+
+class ShardClient {
+public:
+  ShardClient(const vector<string>&); // socket of each shard, in shard order
+  ~ShardClient();
+
+  ShardClient(const ShardClient&) = delete;
+  ShardClient& operator=(const ShardClient&) = delete;
+
+  // methods, run is false if a shard failed
+  bool good () const; // connected to every shard
+  bool run  (const vector<ShardQuery>&, vector<ShardAnswer>&);
+
+  // single queries, empty or 0 if a shard failed
+  vector<string> mostLikelyNext (const vector<string>&, const int&);
+  size_t         frequencyCount (const vector<string>&);
+
+private:
+  vector<int> fds_; // -1 for a shard that couldn't be connected to
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// SHARD CLIENT member functions
+////////////////////////////////////////
+ShardClient::ShardClient(const vector<string>& sockets)
+: fds_(sockets.size(), -1)
+{
+  for (size_t i = 0; i != sockets.size(); ++i)
+    {
+      sockaddr_un address;
+      if (!socketAddress(sockets[i], address))
+	continue;
+
+      fds_[i] = socket(AF_UNIX, SOCK_STREAM, 0);
+      if (fds_[i] != -1 &&
+	  connect(fds_[i], reinterpret_cast<sockaddr*>(&address),
+		  sizeof(address)) != 0)
+	{
+	  close(fds_[i]);
+	  fds_[i] = -1;
+	}
+    }
+}
+
+////////////////////////////////////////
+ShardClient::~ShardClient()
+{
+  for (size_t i = 0; i != fds_.size(); ++i)
+    if (fds_[i] != -1)
+      close(fds_[i]);
+}
+
+////////////////////////////////////////
+bool ShardClient::good() const
+{
+  for (size_t i = 0; i != fds_.size(); ++i)
+    if (fds_[i] == -1)
+      return false;
+
+  return !fds_.empty();
+}
+
+////////////////////////////////////////
+// answers[i] is the answer to queries[i]. Queries without tokens aren't in
+// any shard and get an empty answer
+bool ShardClient::run(const vector<ShardQuery>& queries,
+		      vector<ShardAnswer>& answers)
+{
+  answers.assign(queries.size(), ShardAnswer());
+  if (fds_.empty())
+    return false;
+
+  // which queries go to each shard
+  vector<vector<size_t>> batches(fds_.size());
+  for (size_t i = 0; i != queries.size(); ++i)
+    if (!queries[i].tokens.empty())
+      batches[shardOf(queries[i].tokens[0], fds_.size())].push_back(i);
+
+  bool ok = true;
+  string message;
+  for (size_t s = 0; s != batches.size(); ++s)
+    {
+      if (batches[s].empty())
+	continue;
+
+      message.clear();
+      putU32(message, batches[s].size());
+      for (size_t i = 0; i != batches[s].size(); ++i)
+	putQuery(message, queries[batches[s][i]]);
+      if (fds_[s] == -1 || !sendMessage(fds_[s], message))
+	{
+	  ok = false;
+	  batches[s].clear(); // no answers to wait for
+	}
+    }
+
+  for (size_t s = 0; s != batches.size(); ++s)
+    {
+      if (batches[s].empty())
+	continue;
+
+      if (!recvMessage(fds_[s], message))
+	{
+	  ok = false;
+	  continue;
+	}
+
+      MessageReader in(message);
+      for (size_t i = 0; i != batches[s].size(); ++i)
+	{
+	  const size_t query = batches[s][i];
+	  if (!getAnswer(in, queries[query].type, answers[query]))
+	    {
+	      ok = false;
+	      break;
+	    }
+	}
+    }
+
+  return ok;
+}
+
+////////////////////////////////////////
+vector<string> ShardClient::mostLikelyNext(const vector<string>& tokens,
+					   const int& num)
+{
+  vector<ShardQuery> queries(1);
+  queries[0].type = QUERY_NEXT;
+  queries[0].num = num;
+  queries[0].tokens = tokens;
+
+  vector<ShardAnswer> answers;
+  run(queries, answers);
+  return answers[0].words;
+}
+
+////////////////////////////////////////
+size_t ShardClient::frequencyCount(const vector<string>& tokens)
+{
+  vector<ShardQuery> queries(1);
+  queries[0].type = QUERY_COUNT;
+  queries[0].num = 0;
+  queries[0].tokens = tokens;
+
+  vector<ShardAnswer> answers;
+  run(queries, answers);
+  return answers[0].count;
+}
+
+#endif // CLIENT_H
@@ -8,62 +8,114 @@
 #include "trie.h"
 #include "vocab.h"
 #include <iostream>
-#include <fstream>
 #include <stdlib.h>
 #include <chrono>
 
 using std::cout; using std::cin; using std::getline;
-using std::ifstream;
+using std::stod; using std::stoi;
 
 // used for timing queries
 typedef std::chrono::high_resolution_clock Clock; 
 
+////////////////////////////////////////
+// Most Likely Previous is only offered with a backward trie
+void printMenu(const bool& backward)
+{
+  cout << "Choose a query:\n0. Most Likely Next\n1. Frequency Count\n";
+  if (backward)
+    cout << "2. Most Likely Previous\n";
+  cout << "3. Complete Next Word, the last word entered is the start of the "
+       << "word\n\n";
+}
+
+////////////////////////////////////////
+// runs the queries that return words
+vector<string> wordQuery(const Trie& t, const int& selection,
+			 const vector<string>& input, const int& num)
+{
+  if (selection == 0)
+    return t.mostLikelyNext(input, num);
+  if (selection == 2)
+    return t.mostLikelyPrevious(input, num);
+  if (input.empty())
+    return t.completeNext(input, "", num);
+
+  return t.completeNext(vector<string>(input.begin(), input.end() - 1),
+			input.back(), num);
+}
+
 int main(int argc, char *argv[])
 {
   if (argc < 3)
     {
-      cout << "Need data input file and length of grams\n"
-	   << "example ./a.out file.txt 5\n";
+      cout << "Need data input file, plain, gzip or zstd, and length of the "
+	   << "longest grams\n"
+	   << "optionally a node layout: build, bfs, hot or veb\n"
+	   << "the share of frequency each node's top K should cover\n"
+	   << "the file format: counts, arpa or google\n"
+	   << "and backward to build the backward trie for Most Likely "
+	   << "Previous\n"
+	   << "example ./a.out file.txt 5 hot 0.9 counts backward\n";
       return 1;
     }
 
-  ifstream inFile(argv[1]);
-  if (!inFile)
+  const int gramSize = stoi(argv[2]);
+  const GramFormat format = argc > 5 ? formatFromName(argv[5]) : FORMAT_COUNTS;
+  GramReader vocabReader(argv[1], gramSize, format);
+  if (!vocabReader.good())
     {
       cout << "Could not open file, exiting\n";
       return 1;
     }
 
-  const int gramSize = stoi(argv[2]);
-
   // create vocab, needed to construct the trie
-  Vocab v(inFile, gramSize);
+  Vocab v(vocabReader);
+  if (vocabReader.failed())
+    {
+      cout << "Could not read all of the file, exiting\n";
+      return 1;
+    }
 
   // setup vocab
-  Encoder::vocabID2S_ = &v.vocabID2S;
-  Encoder::vocabS2ID_ = &v.vocabS2ID;
-  
-  // since vocab moves through the file we need to 
-  // start back at the beginning
-  inFile.clear();
-  inFile.seekg(0, std::ios::beg);
+  EncoderBase::vocabS2ID_ = &v.vocabS2ID;
+  EncoderBase::vocabWords_ = &v.vocabWords;
 
   // main output
+  TrieOptions options;
+  if (argc > 3)
+    options.layout = layoutFromName(argv[3]);
+  if (argc > 4)
+    options.topKCoverage = stod(argv[4]);
+  if (argc > 6)
+    options.backward = string(argv[6]) == "backward";
+
+  // with a coverage K is the most any node gets
   cout << "Enter a K value: ";
   int k; cin >> k;
-  Trie t(inFile, gramSize, k);
+
+  // vocab read the file to its end, the trie reads it again from the start
+  GramReader reader(argv[1], gramSize, format);
+  Trie t(reader, k, options);
+  if (reader.failed())
+    {
+      cout << "Could not read all of the file, exiting\n";
+      return 1;
+    }
 
   // show size of data structure
-  cout << "Size of trie in bytes: " << SIZE_TRACKER << "\n";
+  cout << "Size of trie in bytes: " << SIZE_TRACKER - t.backwardBytes() 
+       << "\n";
+  if (options.backward)
+    cout << "Size of backward trie in bytes: " << t.backwardBytes() << "\n";
 
   // get input
-  cout << "Choose a query:\n0. Most Likely Next\n1. Frequency Count\n\n";
+  printMenu(options.backward);
   int querySelection; cin >> querySelection;
   
   int toReturn; 
   vector<string> finalInput; 
   string input;
-  if (querySelection == 0)
+  if (querySelection != 1)
     {
       cout << "Enter how many results to return: ";
       cin >> toReturn;
@@ -83,14 +135,15 @@ int main(int argc, char *argv[])
     {
       
       // queries
-      if (querySelection == 0)
+      if (querySelection == 2 && !options.backward)
+	cout << "Most Likely Previous needs the backward trie, run with "
+	     << "backward\n\n";
+      else if (querySelection != 1)
 	{
 	  auto t1 = Clock::now();
-	  t.mostLikelyNext(finalInput, toReturn);
+	  result = wordQuery(t, querySelection, finalInput, toReturn);
 	  auto t2 = Clock::now();
 
-	  result = t.mostLikelyNext(finalInput, toReturn);
-
 	  // print time for query
 	  cout << "Query took: "
 	       << std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count()
@@ -106,10 +159,8 @@ int main(int argc, char *argv[])
       else
 	{
 	  auto t1 = Clock::now();
-	  t.frequencyCount(finalInput);
-	  auto t2 = Clock::now();
-	  
 	  size_t count = t.frequencyCount(finalInput);
+	  auto t2 = Clock::now();
 	  
 	  // print time for query
           cout << "Query took: "
@@ -124,11 +175,11 @@ int main(int argc, char *argv[])
       finalInput.clear();
       
       // get next input
-      cout << "Choose a query:\n0. Most Likely Next\n1. Frequency Count\n\n";
+      printMenu(options.backward);
       cin >> querySelection;
       
       // selection query
-      if (querySelection == 0)
+      if (querySelection != 1)
 	{
 	  cout << "Enter how many results to return, when done enter '0': ";
 	  cin >> toReturn;
@@ -143,7 +194,4 @@ int main(int argc, char *argv[])
 	  cin >> input;
 	}
     }
-
-  delete Encoder::vocabS2ID_;
-  delete Encoder::vocabID2S_;
 }
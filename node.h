@@ -12,13 +12,74 @@
 #include <string>
 #include <algorithm>
 #include "EF_encoder.h"
+#include "arena.h"
+#include "options.h"
 
 using std::vector;
 using std::string;
-using std::sort; using std::reverse;
+using std::sort; using std::reverse; using std::partial_sort;
 
 // SIZE TRACKER in bytes, stored in EF_encoder.h
 
+const size_t DECODE_CHUNK = 64; // elements decoded at a time when scanning
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// GRAM LIST
+//
+// prefix summed gram IDs, stored in 32 bits when the sums fit and 64 bits
+// otherwise. The width is picked once when the list is built so the scans in
+// get only see one Encoder specialization
+
+class GramList : public ArenaObject {
+public:
+  GramList(const vector<size_t>&); // prefix summed IDs
+  ~GramList() { delete narrow_; delete wide_; }
+
+  // methods
+  size_t size   ()              const { return size_; }
+  size_t find   (const size_t&, const size_t&, const size_t&) const;
+
+private:
+  template <typename E>
+  static size_t findIn(const E&, const size_t&, size_t, const size_t&);
+
+  Encoder<uint32_t> *narrow_;
+  Encoder<size_t>   *wide_;
+  size_t size_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// POINTER LIST
+//
+// pointers to Nodes, stored as prefix sums of their offsets from the lowest
+// one. Siblings are allocated close together so the offsets need far fewer
+// bits than whole addresses
+
+class Node;
+
+class PointerList {
+public:
+  PointerList() : offsets_(nullptr), base_(0) {}
+  ~PointerList() { delete offsets_; }
+
+  PointerList(const PointerList&) = delete;
+  PointerList& operator=(const PointerList&) = delete;
+
+  void set(const vector<Node*>&); // MUST be called once before anything else
+
+  // methods
+  size_t size        ()                     const { return offsets_->size(); }
+  Node*  at          (const size_t&)        const;
+  void   getNodes    (vector<Node*>&)       const; // appends them in order
+  void   deleteNodes ()                     const;
+
+private:
+  Encoder<size_t> *offsets_;
+  size_t base_; // lowest address
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // NODE
@@ -26,36 +87,58 @@ using std::sort; using std::reverse;
 class HashmapEF; // forward declarations
 class SortedEF;
 
-class Node {
+// a successor written out by the queries that don't copy words, the word is
+// EncoderBase::word(gram)
+struct Successor {
+  uint32_t gram;
+  size_t frequency;
+};
+
+class Node : public ArenaObject {
 public:
-  Node(const size_t&, const size_t&, const int&, vector<Node*>);    
+  Node(const size_t&, const size_t&, const int&, vector<Node*>,
+       const TrieOptions&);
   ~Node();
 
   // methods
   size_t         getGramID      ()              const { return gram_; }
   size_t         getFreq        ()              const { return frequency_; }
+  int            getK           ()              const { return k_; }
   Node*          findSuccessor  (const string&) const; // return nullptr 
                                                        // if not found
   vector<string> mostLikelyNext (const size_t&) const;
+  size_t         mostLikelyNext (const size_t&, Successor*) const; // returns
+                                                    // how many were written
+  size_t         successorCount ()              const;
+  void           getSuccessors  (vector<Node*>&) const; // appends all 
+                                                        // successors
   
   // used for sorting
   bool operator<(const Node& rhs) const { return frequency_ < rhs.frequency_; }
   
 private:
-  size_t gram_;
+  friend class Trie;        // layout passes rebuild successors in place
+  friend class TrieBuilder; // and the builder shares identical ones
+
+  void setSuccessors (vector<Node*>, const int&,
+		      const TrieOptions& = TrieOptions());
+  void share         (const int&, SortedEF*, HashmapEF*);
+  void release       ();
+  int  chooseK       (const vector<Node*>&, const int&,
+		      const TrieOptions&) const;
+
+  uint32_t gram_; // IDs fit in 32 bits, so k_ fits in what was padding
+  int k_;         // size of topK_, chosen per node when successors are set
   size_t frequency_;
-  static int k_; // MUST BE GREATER THAN ONE
   HashmapEF *successors_;
   SortedEF *topK_;
 };
 
-int Node::k_ = 0; // static member init
-
 ////////////////////////////////////////////////////////////////////////////////
 //
 // HASHMAP EF
 
-class HashmapEF {
+class HashmapEF : public ArenaObject {
 public:
   // constructor
   HashmapEF(const vector<Node*>&);
@@ -63,22 +146,31 @@ public:
 
   // methods
   Node*  get     (const string&)    const;
+  Node*  getID   (const size_t&)    const; // get by vocab ID
   Node*  getRank (const int&)       const; // inefficient compared to SortedEF's 
+  void   getNodes(vector<Node*>&)   const; // appends Nodes in slot order
   size_t hash    (const size_t& ID) const { return ID % size_; }
   size_t getSize ()                 const { return size_; }
 
+  // Nodes with identical successors can share one table, it is deleted by
+  // whoever releases the last reference
+  void   share   ()                       { ++refs_; }
+  bool   release ()                       { return --refs_ == 0; }
+
 private:
-  Encoder *grams_;    // contains words of the Nodes
-  Encoder *pointers_; // contains pointers to Nodes, indicies 
-                      // correspond with grams_
+  GramList    *grams_;    // contains words of the Nodes
+  PointerList  pointers_; // contains pointers to Nodes, indicies 
+                          // correspond with grams_
+
   size_t size_;
+  uint32_t refs_; // Nodes using this table
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 //
 // SORTED EF
 
-class SortedEF {
+class SortedEF : public ArenaObject {
 public:
   SortedEF(const vector<Node*>&);
   ~SortedEF();
@@ -86,26 +178,149 @@ public:
   // methods
   size_t getSize ()              const { return size_; }
   Node*  get     (const string&) const;
+  Node*  getID   (const size_t&) const; // get by vocab ID
   Node*  getRank (const int&)    const; // sorted in decreasing order so rank 
                                         // 0 is most freq
+  void   getNodes(vector<Node*>&) const; // appends Nodes in rank order
   void   print   ()              const; // for testing
 
+  // shared like HashmapEF
+  void   share   ()                    { ++refs_; }
+  bool   release ()                    { return --refs_ == 0; }
+
 private:
-  Encoder *grams_;    // contains words of the Nodes
-  Encoder *pointers_; // contains pointers to Nodes, indicies
-                      // correspond with grams_
+  GramList        *grams_;    // contains words of the Nodes
+  PointerList      pointers_; // contains pointers to Nodes, indicies
+                              // correspond with grams_
   int size_;
+  uint32_t refs_; // Nodes using this list
 };
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// POINTER LIST member functions
+////////////////////////////////////////
+void PointerList::set(const vector<Node*>& nodes)
+{
+  if (!nodes.empty())
+    base_ = reinterpret_cast<size_t>
+      (*std::min_element(nodes.begin(), nodes.end()));
+
+  // use prefix sums on the offsets to make it into an increasing sequence
+  vector<size_t> prefixSums(nodes.size());
+  for (size_t i = 0; i != nodes.size(); ++i)
+    prefixSums[i] = reinterpret_cast<size_t>(nodes[i]) - base_ +
+      (i == 0 ? 0 : prefixSums[i - 1]);
+
+  offsets_ = new Encoder<size_t>(prefixSums);
+}
+
+////////////////////////////////////////
+// the Node at index is the difference of two neighbouring elements, which
+// are decoded together
+Node* PointerList::at(const size_t& index) const
+{
+  if (index == 0)
+    return reinterpret_cast<Node*>(offsets_->access(0) + base_);
+
+  size_t pair[2];
+  offsets_->decode(pair, index - 1, 2);
+  return reinterpret_cast<Node*>(pair[1] - pair[0] + base_);
+}
+
+////////////////////////////////////////
+void PointerList::getNodes(vector<Node*>& nodes) const
+{
+  size_t chunk[DECODE_CHUNK];
+  size_t previous = 0;
+  for (size_t i = 0; i < size(); i += DECODE_CHUNK)
+    {
+      const size_t count = std::min(DECODE_CHUNK, size() - i);
+      offsets_->decode(chunk, i, count);
+      for (size_t j = 0; j != count; ++j)
+	{
+	  nodes.push_back(reinterpret_cast<Node*>(chunk[j] - previous + base_));
+	  previous = chunk[j];
+	}
+    }
+}
+
+////////////////////////////////////////
+void PointerList::deleteNodes() const
+{
+  vector<Node*> nodes;
+  getNodes(nodes);
+  for (size_t i = 0; i != nodes.size(); ++i)
+    delete nodes[i];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// GRAM LIST member functions
+////////////////////////////////////////
+GramList::GramList(const vector<size_t>& prefixSums)
+: narrow_(nullptr), wide_(nullptr), size_(prefixSums.size())
+{
+  if (!prefixSums.empty() && prefixSums.back() <= UINT32_MAX)
+    narrow_ = new Encoder<uint32_t>(prefixSums);
+  else
+    wide_ = new Encoder<size_t>(prefixSums);
+}
+
+////////////////////////////////////////
+// returns the first index in [from, to) holding ID, or to if there is none
+size_t GramList::find(const size_t& ID, const size_t& from,
+		      const size_t& to) const
+{
+  if (narrow_ != nullptr)
+    return findIn(*narrow_, ID, from, to);
+  return findIn(*wide_, ID, from, to);
+}
+
+////////////////////////////////////////
+template <typename E>
+size_t GramList::findIn(const E& grams, const size_t& ID, size_t from,
+			const size_t& to)
+{
+  typename E::value_type chunk[DECODE_CHUNK];
+  typename E::value_type previous = from == 0 ? 0 : grams.access(from - 1);
+  while (from < to)
+    {
+      const size_t count = std::min(DECODE_CHUNK, to - from);
+      grams.decode(chunk, from, count);
+      for (size_t i = 0; i != count; ++i)
+	{
+	  if (chunk[i] - previous == ID)
+	    return from + i;
+	  previous = chunk[i];
+	}
+      from += count;
+    }
+
+  return to;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // NODE member functions
 ////////////////////////////////////////
-Node::Node(const size_t& gramID, const size_t& freq, const int& k, 
-	   vector<Node*> successors = vector<Node*>())
-: gram_(gramID), frequency_(freq), topK_(nullptr), successors_(nullptr)
+Node::Node(const size_t& gramID, const size_t& freq, const int& k = 0, 
+	   vector<Node*> successors = vector<Node*>(),
+	   const TrieOptions& options = TrieOptions())
+: gram_(gramID), k_(0), frequency_(freq), successors_(nullptr), topK_(nullptr)
+{
+  // track size
+  SIZE_TRACKER += sizeof(*this);
+
+  setSuccessors(successors, k, options);
+}
+
+////////////////////////////////////////
+// builds topK_ and successors_, they must be empty. k is the most successors
+// topK_ can hold, how many it actually gets is chosen by chooseK
+void Node::setSuccessors(vector<Node*> successors, const int& k,
+			 const TrieOptions& options)
 {
-  k_ = k;
   if (successors.size() == 0)
     return;
 
@@ -118,29 +333,25 @@ Node::Node(const size_t& gramID, const size_t& freq, const int& k,
   // need to reverse since sort puts in increasing order
   reverse(successors.begin(), successors.end());
 
-  vector<Node*> sortedTopK(k_);
+  k_ = chooseK(successors, k, options);
 
   // if k_ + 1 is larger than the amount of successors only store the 
-  // exact amount of successors because WE CAN'T have a sequence of length
-  // 1 for the encoder to work properly
+  // exact amount of successors, a HashmapEF with 1 element is bigger than
+  // just putting it in topK_
   if (k_ + 1 >= successors.size())
-    sortedTopK.resize(successors.size());
-
-  for (int i = 0; i != sortedTopK.size(); ++i)
-    sortedTopK[i] = successors[i];
+    k_ = successors.size();
 
-  topK_ = new SortedEF(sortedTopK);
+  if (k_ != 0)
+    topK_ = new SortedEF(vector<Node*>(successors.begin(),
+				       successors.begin() + k_));
 
-  // if k_ + 1 >= successors.size() then leave successors_ nullptr
-  if (k_ + 1 >= successors.size())
+  // if everything is in topK_ then leave successors_ nullptr
+  if (size_t(k_) == successors.size())
     return;
 
   // once topk has been placed erase the first k entries
   successors.erase(successors.begin(), successors.begin() + k_);
   successors_ = new HashmapEF(successors);
-
-  // track size
-  SIZE_TRACKER += sizeof(*this);
 }
 
 ////////////////////////////////////////
@@ -148,8 +359,37 @@ Node::~Node()
 {
   SIZE_TRACKER -= sizeof(*this);
 
-  delete successors_;
-  delete topK_;
+  release();
+}
+
+////////////////////////////////////////
+// drops this Node's successor structures and uses the given ones, which
+// another Node with the same successors built
+void Node::share(const int& k, SortedEF* topK, HashmapEF* successors)
+{
+  release();
+
+  k_ = k;
+  topK_ = topK;
+  successors_ = successors;
+  if (topK_ != nullptr)
+    topK_->share();
+  if (successors_ != nullptr)
+    successors_->share();
+}
+
+////////////////////////////////////////
+// the structures, and the successors in them, are deleted with their last
+// reference
+void Node::release()
+{
+  if (successors_ != nullptr && successors_->release())
+    delete successors_;
+  if (topK_ != nullptr && topK_->release())
+    delete topK_;
+
+  successors_ = nullptr;
+  topK_ = nullptr;
 }
 
 ////////////////////////////////////////
@@ -159,107 +399,141 @@ Node* Node::findSuccessor(const string& word) const
   if (topK_ == nullptr && successors_ == nullptr)
     return nullptr;
 
+  // the word is looked up once for both
+  const size_t ID = EncoderBase::wordID(word);
+  if (ID == 0)
+    return nullptr;
+
   // first search the topK_, then successors_
-  Node* element = topK_->get(word);
-  if (element != nullptr)
+  COUNT_STAT(successorFinds, 1);
+  Node* element = topK_ == nullptr ? nullptr : topK_->getID(ID);
+  COUNT_STAT(topKHits, element != nullptr);
+  if (element != nullptr || successors_ == nullptr)
     return element;
   
   // then search successors hashmapEF
-  return successors_->get(word);
+  return successors_->getID(ID);
 }
 
 ////////////////////////////////////////
-vector<string> Node::mostLikelyNext(const size_t& num) const
+// successors must be sorted most frequent first. With a coverage target, the
+// node gets just enough successors in topK_ to cover that share of its
+// successors' frequency, up to maxK, so skewed nodes answer mostLikelyNext
+// from topK_ alone. Nodes below the minimum frequency get no topK_ at all
+int Node::chooseK(const vector<Node*>& successors, const int& maxK,
+		  const TrieOptions& options) const
 {
-  // return empty vector if there are no successors
-  if (topK_ == nullptr && successors_ == nullptr)
-    return vector<string>();
+  if (frequency_ < options.topKMinFreq)
+    return 0;
+  if (options.topKCoverage <= 0)
+    return maxK;
 
-  vector<string> result(num);
-  size_t maxReturn;
+  size_t total = 0;
+  for (size_t i = 0; i != successors.size(); ++i)
+    total += successors[i]->getFreq();
 
-  // check if there is a successors_ hashmapEF
+  const double target = options.topKCoverage * total;
+  size_t covered = 0, k = 0;
+  for (; int(k) != maxK && k != successors.size() && covered < target; ++k)
+    covered += successors[k]->getFreq();
+
+  return k;
+}
+
+////////////////////////////////////////
+void Node::getSuccessors(vector<Node*>& nodes) const
+{
+  if (topK_ != nullptr)
+    topK_->getNodes(nodes);
   if (successors_ != nullptr)
-    maxReturn = topK_->getSize() + successors_->getSize();
-  else
-    maxReturn = topK_->getSize();
+    successors_->getNodes(nodes);
+}
+
+////////////////////////////////////////
+size_t Node::successorCount() const
+{
+  return (topK_ == nullptr ? 0 : topK_->getSize()) +
+         (successors_ == nullptr ? 0 : successors_->getSize());
+}
+
+////////////////////////////////////////
+vector<string> Node::mostLikelyNext(const size_t& num) const
+{
+  const size_t total = successorCount();
+  vector<Successor> found(num < total ? num : total);
+  found.resize(mostLikelyNext(found.size(), found.data()));
+
+  vector<string> result(found.size());
+  for (size_t i = 0; i != found.size(); ++i)
+    result[i] = EncoderBase::word(found[i].gram);
+  return result;
+}
 
-  // if num is larger than total successors_ then return all successors
-  if (maxReturn < num)
-    result.resize(maxReturn);
+////////////////////////////////////////
+// writes the top num successors to out, most frequent first, all of them if
+// there are fewer. Doesn't allocate once its scratch space has grown to the
+// largest successors_ of a query
+size_t Node::mostLikelyNext(const size_t& num, Successor* out) const
+{
+  const size_t topKSize = topK_ == nullptr ? 0 : topK_->getSize();
+  const size_t total = successorCount();
+  const size_t wanted = num < total ? num : total;
 
   size_t i = 0;
-  for (; i != result.size() && i != topK_->getSize(); ++i)
-    result[i] = 
-      (*Encoder::vocabID2S_)[topK_->getRank(i)->getGramID()]; 
+  for (; i != wanted && i != topKSize; ++i)
+    {
+      const Node *n = topK_->getRank(i);
+      out[i].gram = n->getGramID();
+      out[i].frequency = n->getFreq();
+    }
 
   // if we got all the results we want return
-  if (i == result.size())
-    return result;
-
-  // if we need more we start going through the successors_
-  for (size_t j = 0; j != result.size() - i && j != successors_->getSize(); ++j)
-    result[i + j] = 
-      (*Encoder::vocabID2S_)[successors_->getRank(j)->getGramID()]; 
+  if (i == wanted)
+    return wanted;
+
+  // if we need more, decode successors_ once and sort only the ones needed,
+  // getRank would sort all of them for every rank
+  static thread_local vector<Node*> rest;
+  rest.clear();
+  successors_->getNodes(rest);
+  const size_t needed = wanted - i;
+  partial_sort(rest.begin(), rest.begin() + needed, rest.end(),
+	       [](Node* a, Node* b) { return *b < *a; });
+  for (size_t j = 0; j != needed; ++j)
+    {
+      out[i + j].gram = rest[j]->getGramID();
+      out[i + j].frequency = rest[j]->getFreq();
+    }
 
-  return result;
+  return wanted;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
 // HASHMAP EF member functions
 ////////////////////////////////////////
-HashmapEF::HashmapEF(const vector<Node*>& nodes) : size_(nodes.size())
+HashmapEF::HashmapEF(const vector<Node*>& nodes)
+: grams_(nullptr), size_(nodes.size()), refs_(1)
 {
-  // to make the sequence of gramIDs non-decreasing we add the previous
-  // elements ID and so on
-  vector<size_t*> prefixSumGrams(size_, nullptr); // using size_t pointer
-                                                  // to know where an empty 
-                                                  // pos is since size_t is 
-                                                  // unsigned 
-  vector<size_t> gramPointers(size_);
-
-  // filling grams and pointers vectors
-  bool posFound;
-  size_t hashValue;
+  // place the Nodes by linear probing
+  vector<Node*> slots(size_, nullptr);
   for (size_t i = 0; i != size_; ++i)
     {
-      hashValue = nodes[i]->getGramID();
-      posFound = false;
-      // linear probing stage
-      for (size_t j = 0; !posFound && j != size_; ++j) 
-	if (prefixSumGrams[hash(hashValue + j)] == nullptr)
-	  {
-	    prefixSumGrams[hash(hashValue + j)] = 
-	      new size_t(nodes[i]->getGramID());
-	    gramPointers[hash(hashValue + j)] = 
-	      reinterpret_cast<size_t>(nodes[i]);
-	    
-	    posFound = true;
-	  }
+      size_t pos = hash(nodes[i]->getGramID());
+      while (slots[pos] != nullptr)
+	pos = hash(pos + 1);
+      slots[pos] = nodes[i];
     }
 
-  // use prefix sums on gramPointers to make it into an increasing sequence
-  for (size_t i = 0; i != gramPointers.size(); ++i)
-    if (i != 0)
-      gramPointers[i] = gramPointers[i] + gramPointers[i - 1];
-
-  pointers_ = new Encoder(gramPointers);
-
-  // now that prefixSumGrams is filled with pointers to IDs, we add
-  // the previous element to it to make it increasing, the first element 
-  // remains the same
-  vector<size_t> nonPointerGrams(size_);
+  // to make the sequence of gramIDs non-decreasing we add the previous
+  // elements ID and so on, the first element remains the same
+  vector<size_t> prefixSumGrams(size_);
   for (size_t i = 0; i != size_; ++i)
-    {
-      if (i != 0)
-	nonPointerGrams[i] = 
-	  (*prefixSumGrams[i]) + nonPointerGrams[i - 1];
-      else
-	nonPointerGrams[i] = (*prefixSumGrams[i]);
-    }
+    prefixSumGrams[i] = slots[i]->getGramID() + 
+      (i == 0 ? 0 : prefixSumGrams[i - 1]);
 
-  grams_ = new Encoder(nonPointerGrams);
+  grams_ = new GramList(prefixSumGrams);
+  pointers_.set(slots);
 
   // track size
   SIZE_TRACKER += sizeof(*this);
@@ -273,47 +547,35 @@ HashmapEF::~HashmapEF()
   // grams is just encoded ints so nothing special needs tbd
   delete grams_;
 
-  for (size_t i = 0; i != pointers_->size(); ++i)
-    if (i != 0)
-      delete reinterpret_cast<Node*>(pointers_->access(i) - 
-				     pointers_->access(i - 1));
-  delete reinterpret_cast<Node*>(pointers_->access(0));
-  delete pointers_;
+  pointers_.deleteNodes();
 }
 
 ////////////////////////////////////////
 Node* HashmapEF::get(const string& gramName) const
 {
-  // first retrieve gramName's ID
-  size_t ID = (*Encoder::vocabS2ID_)[gramName];
-  
-  // search for index
-  bool posFound = false;
+  const size_t ID = EncoderBase::wordID(gramName);
+  return ID == 0 ? nullptr : getID(ID);
+}
+
+////////////////////////////////////////
+Node* HashmapEF::getID(const size_t& ID) const
+{
+  COUNT_STAT(hashGets, 1);
+
+  // linear probe from the hashed index to the end, then wrap around
   size_t index = hash(ID);
-  size_t elementID;
-  for (size_t i = 0; !posFound && i != size_; ++i) // linear probe
+  size_t pos = grams_->find(ID, index, size_);
+  if (pos == size_)
     {
-      if (hash(index + i) != 0)
-	elementID = 
-	  grams_->access(hash(index + i)) - 
-	  grams_->access(hash(index + i) - 1);
-      else
-	elementID = grams_->access(0);
-
-      if (elementID == ID)
-	{
-	  index = hash(index + i);
-	  posFound = true;
-	}
+      pos = grams_->find(ID, 0, index);
+      COUNT_STAT(hashProbes, size_ - index + (pos == index ? pos : pos + 1));
+      if (pos == index)
+	return nullptr;
     }
+  else
+    COUNT_STAT(hashProbes, pos - index + 1);
 
-  if (posFound && index != 0)
-    return reinterpret_cast<Node*>(pointers_->access(index) - 
-				   pointers_->access(index - 1));
-  else if (posFound)
-    return reinterpret_cast<Node*>(pointers_->access(index));
-
-  return nullptr;
+  return pointers_.at(pos);
 }
 
 ////////////////////////////////////////
@@ -324,13 +586,7 @@ Node* HashmapEF::getRank(const int& rank) const
 
   vector<Node*> sortedList; // could use a priority queue instead
   // the rest of the function could be done in linear time but I was lazy
-  for (size_t i = 0; i != size_; ++i)
-    {
-      if (i != 0)
-	sortedList.push_back(reinterpret_cast<Node*>(pointers_->access(i) - pointers_->access(i - 1)));
-      else
-	sortedList.push_back(reinterpret_cast<Node*>(pointers_->access(i)));
-    }
+  pointers_.getNodes(sortedList);
   sort(sortedList.begin(), sortedList.end(),
        [](Node* a, Node* b){ return *a < *b; });
   reverse(sortedList.begin(), sortedList.end());
@@ -338,31 +594,29 @@ Node* HashmapEF::getRank(const int& rank) const
   return sortedList[rank];
 }
 
+////////////////////////////////////////
+void HashmapEF::getNodes(vector<Node*>& nodes) const
+{
+  pointers_.getNodes(nodes);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // SORTED EF member functions
 ////////////////////////////////////////
 // nodes are sorted already
-SortedEF::SortedEF(const vector<Node*>& nodes) : size_(nodes.size())
+SortedEF::SortedEF(const vector<Node*>& nodes) 
+: size_(nodes.size()), refs_(1)
 {
   // to make the sequence of gramIDs non-decreasing we add the previous
   // elements ID and so on
   vector<size_t> prefixSumGrams(size_);
-  vector<size_t> gramPointers(size_);
 
-  // filling grams and pointers vectors
+  // filling grams vector
   for (int i = 0; i != size_; ++i)
-    {
-      prefixSumGrams[i] = nodes[i]->getGramID();
-      gramPointers[i] = reinterpret_cast<size_t>(nodes[i]);
-    }
+    prefixSumGrams[i] = nodes[i]->getGramID();
 
-  // use prefix sums on gramPointers to make it into an increasing sequence
-  for (size_t i = 0; i != gramPointers.size(); ++i)
-    if (i != 0)
-      gramPointers[i] = gramPointers[i] + gramPointers[i - 1];
-
-  pointers_ = new Encoder(gramPointers);
+  pointers_.set(nodes);
 
   // now that prefixSumGrams is filled with IDs, we add
   // the previous element to it to make it increasing, the first element
@@ -371,7 +625,7 @@ SortedEF::SortedEF(const vector<Node*>& nodes) : size_(nodes.size())
     if (i != 0)
       prefixSumGrams[i] = prefixSumGrams[i] + prefixSumGrams[i - 1];
 
-  grams_ = new Encoder(prefixSumGrams);
+  grams_ = new GramList(prefixSumGrams);
 
   // track size
   SIZE_TRACKER += sizeof(*this);
@@ -385,43 +639,25 @@ SortedEF::~SortedEF()
   // grams is just encoded ints so nothing special needs tbd
   delete grams_;
 
-  for (size_t i = 0; i != pointers_->size(); ++i)
-    if (i != 0)
-      delete reinterpret_cast<Node*>(pointers_->access(i) -
-                                     pointers_->access(i - 1));
-  delete reinterpret_cast<Node*>(pointers_->access(0));
-  delete pointers_;
+  pointers_.deleteNodes();
 }
 
 ////////////////////////////////////////
 Node* SortedEF::get(const string& gramName) const
 {
   // first get ID
-  size_t ID = (*Encoder::vocabS2ID_)[gramName];
-
-  bool posFound = false;
-  size_t elementID;
-  int i = 0;
-  for (; !posFound && i != size_; ++i)
-    {
-      if (i != 0)
-	elementID = grams_->access(i) - grams_->access(i - 1);
-      else
-	elementID = grams_->access(0);
-
-      if (elementID == ID)
-	posFound = true;
-    }
+  const size_t ID = EncoderBase::wordID(gramName);
+  return ID == 0 ? nullptr : getID(ID);
+}
 
-  // need minus 1 because when the for loop ends it increments i
-  // one more than needed
-  if (posFound && i != 1)
-    return reinterpret_cast<Node*>(pointers_->access(i - 1) - 
-				   pointers_->access(i - 2));
-  else if (posFound)
-    return reinterpret_cast<Node*>(pointers_->access(i - 1));
+////////////////////////////////////////
+Node* SortedEF::getID(const size_t& ID) const
+{
+  const size_t pos = grams_->find(ID, 0, size_);
+  if (pos == size_t(size_))
+    return nullptr;
 
-  return nullptr;
+  return pointers_.at(pos);
 }
 
 ////////////////////////////////////////
@@ -431,19 +667,20 @@ Node* SortedEF::getRank(const int& rank) const
   if (rank > size_)
     return nullptr;
 
-  if (rank != 0)
-    return reinterpret_cast<Node*>(pointers_->access(rank) - 
-				   pointers_->access(rank - 1));
-  else
-    return reinterpret_cast<Node*>(pointers_->access(rank));
+  return pointers_.at(rank);
+}
+
+////////////////////////////////////////
+void SortedEF::getNodes(vector<Node*>& nodes) const
+{
+  pointers_.getNodes(nodes);
 }
 
 ////////////////////////////////////////
 void SortedEF::print() const
 {
   for (size_t i = 0; i != size_; ++i)
-    cout << (*Encoder::vocabID2S_)
-      [reinterpret_cast<Node*>(pointers_->access(i))->getGramID()] 
+    cout << EncoderBase::word(pointers_.at(i)->getGramID()) 
 	 << '\n';
 }
 
@@ -0,0 +1,101 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// FILE:        options.h
+// DESCRIPTION: build options for the trie
+// AUTHOR:      Dan Fabian and Lauren Greathouse
+// DATE:        10/18/2026
+
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// LAYOUT
+//
+// order nodes are placed in memory after the trie is built
+//   BUILD - wherever the build allocated them, no layout pass
+//   BFS   - level by level, siblings next to each other
+//   HOT   - depth first, most frequent child first so hot paths are together
+//   VEB   - van Emde Boas like blocking, the top half of the levels then each
+//           bottom subtree recursively
+
+enum Layout { LAYOUT_BUILD, LAYOUT_BFS, LAYOUT_HOT, LAYOUT_VEB };
+
+const char *LAYOUT_NAMES[] = { "build", "bfs", "hot", "veb" };
+const int LAYOUT_COUNT = 4;
+
+////////////////////////////////////////
+// returns the layout with name, LAYOUT_BUILD if there is none
+Layout layoutFromName(const string& name)
+{
+  for (int i = 0; i != LAYOUT_COUNT; ++i)
+    if (name == LAYOUT_NAMES[i])
+      return static_cast<Layout>(i);
+
+  return LAYOUT_BUILD;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// DIRECTION
+//
+// which trie a query walks, FORWARD is keyed from the first word of a gram
+// and BACKWARD from the last
+
+enum Direction { FORWARD, BACKWARD };
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// TRIE OPTIONS
+
+struct TrieOptions {
+  TrieOptions() 
+    : layout(LAYOUT_BUILD), topKCoverage(0), topKMinFreq(0),
+      backward(false), maxSuccessors(0),
+      entropyThreshold(0), dedup(false) {}
+
+  size_t minCountFor (const int&) const; // of a gram order
+
+  Layout layout;
+
+  // per node top K sizing, K is the most a node can get. With a coverage
+  // above 0 each node keeps only enough successors in its top K to cover
+  // that share of their frequency. Nodes less frequent than topKMinFreq
+  // keep none
+  double topKCoverage;
+  size_t topKMinFreq;
+
+  // also build a trie of every gram reversed, for mostLikelyPrevious
+  bool backward;
+
+  // pruning, the defaults keep every gram. A gram is dropped with every
+  // gram it starts if its count is below minCount[order - 1]. Each Node
+  // keeps at most maxSuccessors, the most frequent. A gram nothing is kept
+  // under is dropped if its weighted difference to the unigram is below
+  // entropyThreshold
+  vector<size_t> minCount;
+  size_t maxSuccessors;
+  double entropyThreshold;
+
+  // Nodes with identical successors, down to the leaves, share one set of
+  // successor structures, making the trie a DAG
+  bool dedup;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// TRIE OPTIONS member functions
+////////////////////////////////////////
+// 0, keeping everything, for orders minCount doesn't cover
+size_t TrieOptions::minCountFor(const int& order) const
+{
+  return size_t(order) > minCount.size() ? 0 : minCount[order - 1];
+}
+
+#endif // OPTIONS_H
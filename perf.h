@@ -0,0 +1,118 @@
+#ifndef PERF_H
+#define PERF_H
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// FILE:        perf.h
+// DESCRIPTION: hardware event counter for the benchmark, uses perf_event_open
+//              on linux and does nothing everywhere else
+// AUTHOR:      Dan Fabian and Lauren Greathouse
+// DATE:        10/18/2026
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// PERF EVENT
+
+enum PerfEvent { PERF_CYCLES, PERF_CACHE_MISSES, PERF_BRANCH_MISSES };
+
+const char *PERF_EVENT_NAMES[] = { "cycles", "cache misses", "branch misses" };
+const int PERF_EVENT_COUNT = 3;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// PERF COUNTER
+//
+// counts one hardware event for the calling thread between start and stop,
+// valid() is false if the counter could not be opened (not linux, no
+// permission, running in a VM without a PMU, ...)
+
+class PerfCounter {
+public:
+  PerfCounter(const PerfEvent&);
+  ~PerfCounter();
+
+  PerfCounter(const PerfCounter&) = delete;
+  PerfCounter& operator=(const PerfCounter&) = delete;
+
+  // methods
+  bool     valid () const { return fd_ != -1; }
+  void     start ();
+  uint64_t stop  (); // returns the events since start
+
+private:
+  int fd_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// PERF COUNTER member functions
+////////////////////////////////////////
+PerfCounter::PerfCounter(const PerfEvent& event)
+: fd_(-1)
+{
+#ifdef __linux__
+  perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  switch (event)
+    {
+    case PERF_CYCLES:        attr.config = PERF_COUNT_HW_CPU_CYCLES;     break;
+    case PERF_CACHE_MISSES:  attr.config = PERF_COUNT_HW_CACHE_MISSES;   break;
+    case PERF_BRANCH_MISSES: attr.config = PERF_COUNT_HW_BRANCH_MISSES;  break;
+    }
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+
+  fd_ = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+}
+
+////////////////////////////////////////
+PerfCounter::~PerfCounter()
+{
+#ifdef __linux__
+  if (fd_ != -1)
+    close(fd_);
+#endif
+}
+
+////////////////////////////////////////
+void PerfCounter::start()
+{
+#ifdef __linux__
+  if (fd_ == -1)
+    return;
+
+  ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+  ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+}
+
+////////////////////////////////////////
+uint64_t PerfCounter::stop()
+{
+  uint64_t count = 0;
+#ifdef __linux__
+  if (fd_ == -1)
+    return 0;
+
+  ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+  if (read(fd_, &count, sizeof(count)) != sizeof(count))
+    count = 0;
+#endif
+  return count;
+}
+
+#endif // PERF_H
@@ -0,0 +1,87 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// FILE:        queue.h
+// DESCRIPTION: bounded queue to pass work between the threads of a pipeline
+// AUTHOR:      Dan Fabian and Lauren Greathouse
+// DATE:        10/18/2026
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+using std::deque;
+using std::mutex; using std::unique_lock;
+using std::condition_variable;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// BOUNDED QUEUE
+//
+// push blocks while the queue is full and pop while it is empty, so a fast
+// stage waits for a slow one instead of filling memory. Once closed, push
+// fails and pop returns what is left then fails
+
+template <typename T>
+class BoundedQueue {
+public:
+  BoundedQueue(const size_t& capacity) : capacity_(capacity), closed_(false) {}
+
+  // methods
+  bool push  (T&&); // false if the queue was closed
+  bool pop   (T&);  // false if the queue is closed and empty
+  void close ();
+
+private:
+  mutex lock_;
+  condition_variable notFull_, notEmpty_;
+  deque<T> items_;
+  size_t capacity_;
+  bool closed_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// BOUNDED QUEUE member functions
+////////////////////////////////////////
+template <typename T>
+bool BoundedQueue<T>::push(T&& item)
+{
+  unique_lock<mutex> guard(lock_);
+  notFull_.wait(guard, [this] { return closed_ || items_.size() < capacity_; });
+  if (closed_)
+    return false;
+
+  items_.push_back(std::move(item));
+  notEmpty_.notify_one();
+  return true;
+}
+
+////////////////////////////////////////
+template <typename T>
+bool BoundedQueue<T>::pop(T& item)
+{
+  unique_lock<mutex> guard(lock_);
+  notEmpty_.wait(guard, [this] { return closed_ || !items_.empty(); });
+  if (items_.empty())
+    return false;
+
+  item = std::move(items_.front());
+  items_.pop_front();
+  notFull_.notify_one();
+  return true;
+}
+
+////////////////////////////////////////
+template <typename T>
+void BoundedQueue<T>::close()
+{
+  unique_lock<mutex> guard(lock_);
+  closed_ = true;
+  notFull_.notify_all();
+  notEmpty_.notify_all();
+}
+
+#endif // QUEUE_H
@@ -0,0 +1,596 @@
+#ifndef READER_H
+#define READER_H
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// FILE:        reader.h
+// DESCRIPTION: reads grams and their counts from the input file, plain or
+//              compressed. Uses zlib and threads, link with -lz -pthread
+// AUTHOR:      Dan Fabian and Lauren Greathouse
+// DATE:        10/18/2026
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <utility>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <zlib.h>
+#include "queue.h"
+
+using std::istream; using std::getline;
+using std::string;
+using std::vector;
+using std::map; using std::unordered_map;
+using std::thread;
+using std::atomic;
+
+const size_t READ_BLOCK = 1 << 20;   // bytes decompressed at a time
+const size_t PIPELINE_DEPTH = 8;     // chunks or batches waiting per stage
+
+// ARPA files give log10 probabilities, a gram's count is its joint
+// probability times this, at least 1. These are pseudo counts, not times a
+// gram was seen, so TrieOptions::minCount and topKMinFreq are thresholds on
+// ARPA_SCALE times a probability for ARPA input
+const double ARPA_SCALE = 1e15;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// GRAM FORMAT
+//
+// how the lines of the input file are laid out
+//   COUNTS - words separated by spaces, a tab and the count
+//   ARPA   - an ARPA language model, log10 probability, a tab, the words and
+//            maybe a tab and a backoff weight. Section lines are skipped.
+//            The probabilities are of the last word given the others, each
+//            is added to the joint log probability of its context so the
+//            count is p(w1) p(w2|w1) ... p(wn|w1...wn-1) times ARPA_SCALE,
+//            and no gram counts more than its prefix. Contexts must come
+//            before the grams they start, as in the n-gram sections of an
+//            ARPA file, a gram whose context is missing counts its own
+//            probability only
+//   GOOGLE - Google Books Ngram TSV, the words, a tab, then either the year,
+//            match count and volume count separated by tabs (version 2, one
+//            line per year) or one year,match count,volume count per tab
+//            (version 3). The match counts of every year are summed
+
+enum GramFormat { FORMAT_COUNTS, FORMAT_ARPA, FORMAT_GOOGLE };
+
+const char *FORMAT_NAMES[] = { "counts", "arpa", "google" };
+const int FORMAT_COUNT = 3;
+
+////////////////////////////////////////
+// returns the format with name, FORMAT_COUNTS if there is none
+GramFormat formatFromName(const string& name)
+{
+  for (int i = 0; i != FORMAT_COUNT; ++i)
+    if (name == FORMAT_NAMES[i])
+      return static_cast<GramFormat>(i);
+
+  return FORMAT_COUNTS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// INPUT FILE
+//
+// a file read as plain bytes whether it is plain, gzip or zstd. zlib reads
+// plain and gzip files, zstd files are piped through the zstd tool since
+// there is no zstd library to link with
+
+class InputFile {
+public:
+  InputFile(const string&);
+  ~InputFile();
+
+  InputFile(const InputFile&) = delete;
+  InputFile& operator=(const InputFile&) = delete;
+
+  // methods
+  bool   good   () const { return opened_; }
+  bool   failed () const { return failed_; } // a read error, a corrupt or
+                                             // truncated file or zstd failing
+  size_t read   (char*, const size_t&);      // 0 at the end of the file or
+                                             // once it failed
+
+private:
+  gzFile gz_;
+  FILE *pipe_;
+  bool opened_;
+  atomic<bool> failed_; // set by the decompressing thread
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// GRAM READER
+//
+// each line is a gram of 1 to maxLen words in one of the GramFormats. Lines
+// of different lengths can be mixed in one file, lines that aren't grams or
+// have more than maxLen words are skipped. The same gram can come more than
+// once, the Trie and Vocab builds sum its counts.
+//
+// Given a file name the reading is a pipeline, one thread decompresses the
+// file and cuts it into chunks of whole lines, several threads parse the
+// chunks into grams, and the caller of next builds from them. Each hand off
+// is a BoundedQueue so the stages run at the speed of the slowest instead of
+// one after the other. Grams are handed out in the order of the file. The
+// file is opened again for every pass instead of seeking back
+
+class GramReader {
+public:
+  GramReader(istream& in, const int& maxLen, 
+	     const GramFormat& format = FORMAT_COUNTS)
+    : in_(&in), maxLen_(maxLen), format_(format), file_(""), chunks_(0), 
+      batches_(0), parsing_(0), seq_(0), next_(0) {}
+  GramReader(const string&, const int&, const GramFormat& = FORMAT_COUNTS);
+  ~GramReader();
+
+  GramReader(const GramReader&) = delete;
+  GramReader& operator=(const GramReader&) = delete;
+
+  // methods
+  bool next   (vector<string>&, size_t&); // false at the end of the input
+  bool good   () const { return in_ != nullptr || file_.good(); }
+  bool failed () const; // after next is false, if the input ended early
+  int  maxLen () const { return maxLen_; }
+
+private:
+  struct Gram {
+    vector<string> tokens;
+    size_t count;
+    double logProb;   // ARPA only, the count before it is joint and scaled
+    uint64_t key;     // ARPA only, hash of the words
+    uint64_t context; // and of all but the last word
+  };
+  struct Chunk {  // whole lines of the file
+    size_t seq;   // its place in the file
+    string text;
+  };
+  struct Batch {  // the grams of a Chunk
+    size_t seq;
+    vector<Gram> grams;
+  };
+
+  static bool parse      (const char*, const char*, const size_t&,
+			  const GramFormat&, Gram&);
+  static bool words      (const char*, const char*, const size_t&,
+			  vector<string>&);
+  void        decompress ();
+  void        split      ();
+  void        joint      (Gram&);
+
+  istream *in_; // nullptr when reading a file through the pipeline
+  size_t maxLen_;
+  GramFormat format_;
+  string line_;
+
+  InputFile file_;
+  BoundedQueue<Chunk> chunks_;
+  BoundedQueue<Batch> batches_;
+  thread decompressor_;
+  vector<thread> splitters_;
+  atomic<size_t> parsing_;      // splitters still running, the last one
+                                // closes batches_
+  map<size_t, vector<Gram>> early_; // Batches that came before their turn
+  size_t seq_;                  // Batch to hand out next
+  vector<Gram> batch_;          // being handed out by next
+  size_t next_;
+
+  // ARPA joint log probability of each gram shorter than maxLen_, by
+  // Gram::key
+  unordered_map<uint64_t, double> contexts_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// INPUT FILE member functions
+////////////////////////////////////////
+InputFile::InputFile(const string& fileName)
+: gz_(nullptr), pipe_(nullptr), opened_(false), failed_(false)
+{
+  if (fileName.empty())
+    return;
+
+  // zstd frames start with 28 b5 2f fd
+  unsigned char magic[4] = { 0, 0, 0, 0 };
+  FILE *probe = fopen(fileName.c_str(), "rb");
+  if (probe == nullptr)
+    return;
+  const size_t got = fread(magic, 1, 4, probe);
+  fclose(probe);
+
+  if (got == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f &&
+      magic[3] == 0xfd)
+    {
+      // single quotes keep the shell from reading the name
+      string quoted = "'";
+      for (size_t i = 0; i != fileName.size(); ++i)
+	if (fileName[i] == '\'')
+	  quoted += "'\\''";
+	else
+	  quoted += fileName[i];
+      pipe_ = popen(("zstd -dc -- " + quoted + "'").c_str(), "r");
+      opened_ = pipe_ != nullptr;
+      return;
+    }
+
+  gz_ = gzopen(fileName.c_str(), "rb");
+  opened_ = gz_ != nullptr;
+  if (gz_ != nullptr)
+    gzbuffer(gz_, READ_BLOCK);
+}
+
+////////////////////////////////////////
+InputFile::~InputFile()
+{
+  if (gz_ != nullptr)
+    gzclose(gz_);
+  if (pipe_ != nullptr)
+    pclose(pipe_);
+}
+
+////////////////////////////////////////
+// at the end a zstd pipe is closed to get the exit status of zstd, it is
+// only a clean end if zstd succeeded
+size_t InputFile::read(char* out, const size_t& size)
+{
+  if (pipe_ != nullptr)
+    {
+      const size_t got = fread(out, 1, size, pipe_);
+      if (got != 0)
+	return got;
+
+      const bool error = ferror(pipe_) != 0;
+      const int status = pclose(pipe_);
+      pipe_ = nullptr;
+      failed_ = error || status != 0;
+      return 0;
+    }
+  if (gz_ == nullptr)
+    return 0;
+
+  // a truncated or corrupt gzip file ends early, gzerror tells them apart
+  // from the real end
+  const int got = gzread(gz_, out, size);
+  int error = Z_OK;
+  if (got <= 0)
+    gzerror(gz_, &error);
+  if (got < 0 || (error != Z_OK && error != Z_STREAM_END))
+    {
+      failed_ = true;
+      gzclose(gz_);
+      gz_ = nullptr;
+      return 0;
+    }
+
+  return got;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// GRAM READER member functions
+////////////////////////////////////////
+GramReader::GramReader(const string& fileName, const int& maxLen,
+		       const GramFormat& format)
+: in_(nullptr), maxLen_(maxLen), format_(format), file_(fileName), 
+  chunks_(PIPELINE_DEPTH), batches_(PIPELINE_DEPTH), parsing_(0), seq_(0),
+  next_(0)
+{
+  if (!file_.good())
+    {
+      batches_.close();
+      return;
+    }
+
+  // one core decompresses and one builds, the rest parse
+  const size_t cores = thread::hardware_concurrency();
+  parsing_ = cores > 3 ? cores - 2 : 1;
+
+  decompressor_ = thread(&GramReader::decompress, this);
+  for (size_t i = 0; i != parsing_; ++i)
+    splitters_.push_back(thread(&GramReader::split, this));
+}
+
+////////////////////////////////////////
+// stops the pipeline if the grams weren't all read
+GramReader::~GramReader()
+{
+  chunks_.close();
+  batches_.close();
+  if (decompressor_.joinable())
+    decompressor_.join();
+  for (size_t i = 0; i != splitters_.size(); ++i)
+    splitters_[i].join();
+}
+
+////////////////////////////////////////
+bool GramReader::failed() const
+{
+  return in_ != nullptr ? in_->bad() : file_.failed();
+}
+
+////////////////////////////////////////
+bool GramReader::next(vector<string>& tokens, size_t& count)
+{
+  if (in_ != nullptr)
+    {
+      Gram gram;
+      while (getline(*in_, line_))
+	if (parse(line_.data(), line_.data() + line_.size(), maxLen_, format_,
+		  gram))
+	  {
+	    if (format_ == FORMAT_ARPA)
+	      joint(gram);
+	    tokens.swap(gram.tokens);
+	    count = gram.count;
+	    return true;
+	  }
+
+      unordered_map<uint64_t, double>().swap(contexts_);
+      return false;
+    }
+
+  // the splitters finish Batches out of order, ones that are early wait
+  // in early_ for the Batches before them
+  while (next_ == batch_.size())
+    {
+      batch_.clear();
+      next_ = 0;
+
+      auto waiting = early_.find(seq_);
+      if (waiting != early_.end())
+	{
+	  batch_.swap(waiting->second);
+	  early_.erase(waiting);
+	  ++seq_;
+	  continue;
+	}
+
+      Batch batch;
+      if (!batches_.pop(batch))
+	{
+	  unordered_map<uint64_t, double>().swap(contexts_);
+	  return false;
+	}
+      if (batch.seq == seq_)
+	{
+	  batch_.swap(batch.grams);
+	  ++seq_;
+	}
+      else
+	early_[batch.seq].swap(batch.grams);
+    }
+
+  if (format_ == FORMAT_ARPA)
+    joint(batch_[next_]);
+  tokens.swap(batch_[next_].tokens);
+  count = batch_[next_].count;
+  ++next_;
+  return true;
+}
+
+////////////////////////////////////////
+// makes an ARPA gram's count its joint probability, grams come here in the
+// order of the file so their contexts already have theirs. The words were
+// hashed by parse on the splitter threads, this is one lookup and insert
+void GramReader::joint(Gram& gram)
+{
+  double logProb = gram.logProb;
+  if (gram.tokens.size() > 1)
+    {
+      auto context = contexts_.find(gram.context);
+      if (context != contexts_.end())
+	logProb += context->second;
+    }
+
+  if (gram.tokens.size() < maxLen_)
+    contexts_[gram.key] = logProb;
+
+  const double scaled = ARPA_SCALE * pow(10, logProb);
+  gram.count = scaled < 1 ? 1 : llround(scaled);
+}
+
+////////////////////////////////////////
+// first stage, runs on its own thread. Each Chunk ends at the last newline
+// read, the rest of the line starts the next Chunk
+void GramReader::decompress()
+{
+  string rest;
+  size_t seq = 0;
+  while (true)
+    {
+      Chunk chunk;
+      chunk.seq = seq;
+      chunk.text.swap(rest);
+      const size_t start = chunk.text.size();
+      chunk.text.resize(start + READ_BLOCK);
+      const size_t got = file_.read(&chunk.text[start], READ_BLOCK);
+      chunk.text.resize(start + got);
+      if (got == 0) // the last line might not end in a newline
+	{
+	  if (!chunk.text.empty())
+	    chunks_.push(std::move(chunk));
+	  break;
+	}
+
+      const size_t end = chunk.text.rfind('\n');
+      if (end == string::npos) // a line longer than a block
+	{
+	  rest.swap(chunk.text);
+	  continue;
+	}
+
+      rest.assign(chunk.text, end + 1, string::npos);
+      chunk.text.resize(end + 1);
+      if (!chunks_.push(std::move(chunk)))
+	break;
+      ++seq;
+    }
+
+  chunks_.close();
+}
+
+////////////////////////////////////////
+// second stage, runs on several threads. Google version 2 files have a
+// line per year, so a gram is often on the lines right after itself, those
+// are summed here
+void GramReader::split()
+{
+  Chunk chunk;
+  Gram gram;
+  while (chunks_.pop(chunk))
+    {
+      Batch batch;
+      batch.seq = chunk.seq;
+
+      const char *text = chunk.text.data(), *end = text + chunk.text.size();
+      while (text != end)
+	{
+	  const char *line = text;
+	  while (text != end && *text != '\n')
+	    ++text;
+	  const char *last = text;
+	  if (text != end)
+	    ++text;
+
+	  if (!parse(line, last, maxLen_, format_, gram))
+	    continue;
+	  if (!batch.grams.empty() && batch.grams.back().tokens == gram.tokens)
+	    batch.grams.back().count += gram.count;
+	  else
+	    batch.grams.push_back(std::move(gram));
+	}
+
+      if (!batches_.push(std::move(batch)))
+	break;
+    }
+
+  if (--parsing_ == 0)
+    batches_.close();
+}
+
+////////////////////////////////////////
+// parses the line [first, last), false if it isn't a gram to read
+bool GramReader::parse(const char* first, const char* last,
+		       const size_t& maxLen, const GramFormat& format,
+		       Gram& gram)
+{
+  vector<string>& tokens = gram.tokens;
+  size_t& count = gram.count;
+
+  if (last != first && last[-1] == '\r')
+    --last;
+
+  // the counts format has the words before the last tab, the others before
+  // or after the first one
+  const char *tab = first;
+  while (tab != last && *tab != '\t')
+    ++tab;
+  if (tab == last)
+    return false;
+
+  if (format == FORMAT_ARPA)
+    {
+      // the count is made joint by next, in the order of the file
+      char *number;
+      gram.logProb = strtod(first, &number);
+      if (number != tab)
+	return false;
+
+      const char *wordsEnd = tab + 1;
+      while (wordsEnd != last && *wordsEnd != '\t')
+	++wordsEnd;
+      count = 0;
+      if (!words(tab + 1, wordsEnd, maxLen, tokens))
+	return false;
+
+      // FNV-1a of the words, each followed by a space which no word has.
+      // 64 bits make two grams of one file sharing a key unlikely enough
+      gram.key = 14695981039346656037ull;
+      for (size_t i = 0; i != tokens.size(); ++i)
+	{
+	  if (i + 1 == tokens.size())
+	    gram.context = gram.key;
+	  for (size_t j = 0; j != tokens[i].size(); ++j)
+	    gram.key = (gram.key ^ static_cast<unsigned char>(tokens[i][j])) *
+	               1099511628211ull;
+	  gram.key = (gram.key ^ ' ') * 1099511628211ull;
+	}
+      return true;
+    }
+
+  if (format == FORMAT_GOOGLE)
+    {
+      // version 3 fields are year,match count,volume count
+      count = 0;
+      const char *field = tab + 1;
+      bool version3 = false;
+      for (const char *c = field; c != last && *c != '\t'; ++c)
+	version3 = version3 || *c == ',';
+
+      if (!version3) // year, match count, volume count
+	{
+	  while (field != last && *field != '\t')
+	    ++field;
+	  if (field == last)
+	    return false;
+	  count = strtoull(field + 1, nullptr, 10);
+	}
+      else
+	while (field != last)
+	  {
+	    const char *comma = field;
+	    while (comma != last && *comma != ',' && *comma != '\t')
+	      ++comma;
+	    if (comma != last && *comma == ',')
+	      count += strtoull(comma + 1, nullptr, 10);
+	    while (field != last && *field != '\t')
+	      ++field;
+	    if (field != last)
+	      ++field;
+	  }
+
+      return words(first, tab, maxLen, tokens);
+    }
+
+  tab = last;
+  while (tab[-1] != '\t')
+    --tab;
+  count = strtoull(tab, nullptr, 10);
+  return words(first, tab - 1, maxLen, tokens);
+}
+
+////////////////////////////////////////
+// splits [first, last) into tokens, false if there are none or more than 
+// maxLen
+bool GramReader::words(const char* first, const char* last,
+		       const size_t& maxLen, vector<string>& tokens)
+{
+  tokens.clear();
+  const char *word = first;
+  while (word != last)
+    {
+      while (word != last && (*word == ' ' || *word == '\t'))
+	++word;
+      const char *end = word;
+      while (end != last && *end != ' ' && *end != '\t')
+	++end;
+      if (end == word)
+	break;
+
+      if (tokens.size() == maxLen)
+	return false;
+      tokens.push_back(string(word, end));
+      word = end;
+    }
+
+  return !tokens.empty();
+}
+
+#endif // READER_H
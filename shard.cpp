@@ -0,0 +1,314 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// FILE:        shard.cpp
+// DESCRIPTION: splits a gram file into shards, serves one shard's trie over
+//              a Unix domain socket, or sends queries to the shard servers
+// AUTHOR:      Dan Fabian and Lauren Greathouse
+// DATE:        10/18/2026
+
+#include "trie.h"
+#include "vocab.h"
+#include "client.h"
+#include <iostream>
+#include <sstream>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <list>
+#include <functional>
+
+using std::cout; using std::cin; using std::getline;
+using std::stoul; using std::stoi;
+using std::stringstream;
+using std::thread;
+using std::mutex; using std::lock_guard;
+using std::atomic;
+using std::list;
+
+// used for timing queries
+typedef std::chrono::high_resolution_clock Clock;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// SERVER
+
+// Trie queries only read the trie, but the QUERY_STATS counters aren't
+// atomic so with them compiled in the clients take turns
+#ifdef NGRAM_STATS
+mutex STATS_LOCK;
+#endif
+
+// a client's connection and the thread answering it
+struct Client {
+  int fd;
+  atomic<bool> done; // set by the thread when the client went away
+  thread worker;
+};
+
+////////////////////////////////////////
+// answers the batches from one client until it goes away or the server
+// shuts the connection down, serve closes fd
+void answer(const Trie& t, Client& client)
+{
+  const int fd = client.fd;
+  string request, response;
+  ShardQuery query;
+  ShardAnswer result;
+  vector<Successor> found; // grows to the largest num asked for
+  while (recvMessage(fd, request))
+    {
+      MessageReader in(request);
+      uint32_t queries;
+      if (!in.getU32(queries))
+	break;
+
+      response.clear();
+      bool ok = true;
+      {
+#ifdef NGRAM_STATS
+	lock_guard<mutex> guard(STATS_LOCK);
+#endif
+	for (uint32_t i = 0; i != queries; ++i)
+	  {
+	    ok = getQuery(in, query);
+	    if (!ok)
+	      break;
+
+	    if (query.type == QUERY_COUNT)
+	      {
+		result.count = t.frequencyCount(query.tokens);
+		putAnswer(response, query.type, result);
+		continue;
+	      }
+
+	    // words go from the vocab straight into the response, a num
+	    // larger than the vocab can't be filled anyway
+	    const size_t num = query.num < EncoderBase::vocabWords_->size() ?
+	                       query.num : EncoderBase::vocabWords_->size();
+	    if (found.size() < num)
+	      found.resize(num);
+	    const size_t got = t.mostLikelyNext(query.tokens, num, found.data());
+	    putU32(response, got);
+	    for (size_t j = 0; j != got; ++j)
+	      putString(response, EncoderBase::word(found[j].gram));
+	  }
+      }
+
+      if (!ok || !sendMessage(fd, response))
+	break;
+    }
+
+  client.done = true;
+}
+
+////////////////////////////////////////
+// joins the threads of the clients that went away, all of them with all.
+// Connections still open are shut down first so their threads finish
+void reap(list<Client>& clients, const bool& all)
+{
+  for (auto client = clients.begin(); client != clients.end(); )
+    {
+      if (all && !client->done)
+	shutdown(client->fd, SHUT_RDWR);
+      if (!all && !client->done)
+	{
+	  ++client;
+	  continue;
+	}
+
+      client->worker.join();
+      close(client->fd);
+      client = clients.erase(client);
+    }
+}
+
+////////////////////////////////////////
+// serves t on the socket at path until the process is stopped, each client
+// gets its own thread. Running out of descriptors or memory for a moment 
+// doesn't stop it, any other accept error does once every client thread
+// has finished
+int serve(const Trie& t, const string& path)
+{
+  sockaddr_un address;
+  if (!socketAddress(path, address))
+    {
+      cout << "Socket path too long, exiting\n";
+      return 1;
+    }
+
+  const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(path.c_str());
+  if (listener == -1 ||
+      bind(listener, reinterpret_cast<sockaddr*>(&address),
+	   sizeof(address)) != 0 ||
+      listen(listener, SOMAXCONN) != 0)
+    {
+      cout << "Could not listen on " << path << ", exiting\n";
+      return 1;
+    }
+
+  cout << "Serving on " << path << '\n' << std::flush;
+  list<Client> clients; // a list so each Client stays where its thread is
+  while (true)
+    {
+      const int fd = accept(listener, nullptr, nullptr);
+      reap(clients, false);
+      if (fd == -1 && (errno == EINTR || errno == ECONNABORTED))
+	continue;
+      if (fd == -1 && (errno == EMFILE || errno == ENFILE || 
+		       errno == ENOBUFS || errno == ENOMEM))
+	{
+	  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	  continue;
+	}
+      if (fd == -1)
+	break;
+
+      clients.emplace_back();
+      Client& client = clients.back();
+      client.fd = fd;
+      client.done = false;
+      client.worker = thread(answer, std::cref(t), std::ref(client));
+    }
+
+  cout << "Could not accept clients, exiting\n";
+  reap(clients, true);
+  close(listener);
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// CLIENT
+
+////////////////////////////////////////
+// each line of in is a query, "next num word word ..." or "count word ...".
+// All of them go in one run so each shard gets one batch
+int query(const vector<string>& sockets)
+{
+  ShardClient client(sockets);
+  if (!client.good())
+    {
+      cout << "Could not connect to every shard, exiting\n";
+      return 1;
+    }
+
+  vector<ShardQuery> queries;
+  string line, type;
+  while (getline(cin, line))
+    {
+      stringstream words(line);
+      ShardQuery query;
+      query.num = 0;
+      if (!(words >> type))
+	continue;
+      if (type == "next")
+	{
+	  query.type = QUERY_NEXT;
+	  words >> query.num;
+	}
+      else
+	query.type = QUERY_COUNT;
+
+      string word;
+      while (words >> word)
+	query.tokens.push_back(word);
+      queries.push_back(query);
+    }
+
+  vector<ShardAnswer> answers;
+  auto t1 = Clock::now();
+  const bool ok = client.run(queries, answers);
+  auto t2 = Clock::now();
+
+  for (size_t i = 0; i != answers.size(); ++i)
+    {
+      if (queries[i].type == QUERY_COUNT)
+	cout << answers[i].count;
+      for (size_t j = 0; j != answers[i].words.size(); ++j)
+	cout << (j == 0 ? "" : " ") << answers[i].words[j];
+      cout << '\n';
+    }
+  cout << queries.size() << " queries took "
+       << std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count()
+       << " microseconds\n";
+
+  return ok ? 0 : 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// MAIN
+
+int main(int argc, char *argv[])
+{
+  const string mode = argc > 1 ? argv[1] : "";
+  if (mode == "split" && argc > 5)
+    {
+      const GramFormat format = argc > 6 ? formatFromName(argv[6])
+	                                 : FORMAT_COUNTS;
+      GramReader reader(argv[2], stoi(argv[3]), format);
+      if (!reader.good())
+	{
+	  cout << "Could not open file, exiting\n";
+	  return 1;
+	}
+
+      const size_t written = writeShards(reader, argv[5], stoul(argv[4]));
+      if (reader.failed())
+	{
+	  cout << "Could not read all of the file, exiting\n";
+	  return 1;
+	}
+      cout << "Wrote " << written << " grams\n";
+      return written == 0 ? 1 : 0;
+    }
+
+  if (mode == "serve" && argc > 5)
+    {
+      const int gramSize = stoi(argv[3]);
+      GramReader vocabReader(argv[2], gramSize);
+      if (!vocabReader.good())
+	{
+	  cout << "Could not open file, exiting\n";
+	  return 1;
+	}
+
+      Vocab v(vocabReader);
+      if (vocabReader.failed())
+	{
+	  cout << "Could not read all of the file, exiting\n";
+	  return 1;
+	}
+          EncoderBase::vocabS2ID_ = &v.vocabS2ID;
+      EncoderBase::vocabWords_ = &v.vocabWords;
+
+      TrieOptions options;
+      if (argc > 6)
+	options.layout = layoutFromName(argv[6]);
+      GramReader reader(argv[2], gramSize);
+      Trie t(reader, stoi(argv[4]), options);
+      if (reader.failed())
+	{
+	  cout << "Could not read all of the file, exiting\n";
+	  return 1;
+	}
+      return serve(t, argv[5]);
+    }
+
+  if (mode == "query" && argc > 2)
+    return query(vector<string>(argv + 2, argv + argc));
+
+  cout << "Need a mode\n"
+       << "split file gramLen shards prefix [format], writes prefix.0 ...\n"
+       << "serve shardFile gramLen K socket [layout], one per shard\n"
+       << "query socket0 socket1 ..., the sockets in shard order, reads\n"
+       << "queries from stdin, next num word ... or count word ...\n"
+       << "example ./shard split file.txt 5 4 shards\n"
+       << "        ./shard serve shards.0 5 3 /tmp/shard0 hot &\n"
+       << "        ./shard query /tmp/shard0 /tmp/shard1 /tmp/shard2 "
+       << "/tmp/shard3 < queries.txt\n";
+  return 1;
+}
@@ -0,0 +1,362 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// FILE:        shard.h
+// DESCRIPTION: splits the grams into shards by their first word and the
+//              binary protocol the shard servers and clients talk over Unix
+//              domain sockets
+// AUTHOR:      Dan Fabian and Lauren Greathouse
+// DATE:        10/18/2026
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fstream>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "reader.h"
+
+using std::string; using std::string_view;
+using std::vector;
+using std::ofstream;
+using std::to_string;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// SHARDING
+//
+// every gram starting with the same word is in the same shard, so each shard
+// is a whole forward trie for its root words and a query only needs the
+// shard of its first word
+
+////////////////////////////////////////
+// FNV-1a, the same in every process unlike std::hash
+size_t shardOf(const string& root, const size_t& shards)
+{
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i != root.size(); ++i)
+    {
+      hash ^= static_cast<unsigned char>(root[i]);
+      hash *= 1099511628211ull;
+    }
+
+  return hash % shards;
+}
+
+////////////////////////////////////////
+// file the shard's grams are written to
+string shardFileName(const string& prefix, const size_t& shard)
+{
+  return prefix + "." + to_string(shard);
+}
+
+////////////////////////////////////////
+// writes each gram the reader gives to its shard file, in the counts format.
+// Returns the grams written, 0 if a file couldn't be opened
+size_t writeShards(GramReader& reader, const string& prefix,
+		   const size_t& shards)
+{
+  vector<ofstream*> files(shards);
+  bool opened = true;
+  for (size_t i = 0; i != shards; ++i)
+    {
+      files[i] = new ofstream(shardFileName(prefix, i).c_str());
+      opened = opened && files[i]->good();
+    }
+
+  size_t written = 0;
+  vector<string> tokens;
+  size_t count;
+  while (opened && reader.next(tokens, count))
+    {
+      ofstream& out = *files[shardOf(tokens[0], shards)];
+      for (size_t i = 0; i != tokens.size(); ++i)
+	out << (i == 0 ? "" : " ") << tokens[i];
+      out << '\t' << count << '\n';
+      ++written;
+    }
+
+  for (size_t i = 0; i != shards; ++i)
+    delete files[i];
+  return written;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// PROTOCOL
+//
+// every message is a 32 bit length then that many bytes. Numbers are little
+// endian, strings are a 32 bit length then their bytes.
+//
+// A request is a batch, the number of queries then each query as
+//   type (8 bits, QUERY_NEXT or QUERY_COUNT), num (32 bits, results wanted
+//   by QUERY_NEXT), the number of tokens and the tokens
+// and its response has an answer for each query in the same order
+//   QUERY_NEXT  - the number of words and the words
+//   QUERY_COUNT - the count (64 bits)
+
+enum QueryType { QUERY_NEXT, QUERY_COUNT };
+
+// the most a message can be, anything longer is a broken peer
+const uint32_t MAX_MESSAGE = 1 << 30;
+
+struct ShardQuery {
+  QueryType type;
+  uint32_t num;
+  vector<string> tokens;
+};
+
+struct ShardAnswer {
+  vector<string> words; // QUERY_NEXT
+  uint64_t count;       // QUERY_COUNT
+};
+
+////////////////////////////////////////
+// appends to a message
+void putU8(string& out, const uint8_t& n)
+{
+  out += static_cast<char>(n);
+}
+
+void putU32(string& out, const uint32_t& n)
+{
+  for (int i = 0; i != 4; ++i)
+    out += static_cast<char>(n >> (8 * i));
+}
+
+void putU64(string& out, const uint64_t& n)
+{
+  for (int i = 0; i != 8; ++i)
+    out += static_cast<char>(n >> (8 * i));
+}
+
+void putString(string& out, const string_view& s)
+{
+  putU32(out, s.size());
+  out += s;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// MESSAGE READER
+//
+// reads the fields of a message in order, each get is false once the message
+// runs out
+
+class MessageReader {
+public:
+  MessageReader(const string& message)
+    : at_(message.data()), end_(message.data() + message.size()) {}
+
+  // methods
+  bool getU8     (uint8_t&);
+  bool getU32    (uint32_t&);
+  bool getU64    (uint64_t&);
+  bool getString (string&);
+
+private:
+  const char *at_, *end_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// MESSAGE READER member functions
+////////////////////////////////////////
+bool MessageReader::getU8(uint8_t& n)
+{
+  if (at_ == end_)
+    return false;
+
+  n = static_cast<unsigned char>(*at_++);
+  return true;
+}
+
+////////////////////////////////////////
+bool MessageReader::getU32(uint32_t& n)
+{
+  if (end_ - at_ < 4)
+    return false;
+
+  n = 0;
+  for (int i = 0; i != 4; ++i)
+    n |= uint32_t(static_cast<unsigned char>(*at_++)) << (8 * i);
+  return true;
+}
+
+////////////////////////////////////////
+bool MessageReader::getU64(uint64_t& n)
+{
+  if (end_ - at_ < 8)
+    return false;
+
+  n = 0;
+  for (int i = 0; i != 8; ++i)
+    n |= uint64_t(static_cast<unsigned char>(*at_++)) << (8 * i);
+  return true;
+}
+
+////////////////////////////////////////
+bool MessageReader::getString(string& s)
+{
+  uint32_t size;
+  if (!getU32(size) || size_t(end_ - at_) < size)
+    return false;
+
+  s.assign(at_, size);
+  at_ += size;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// QUERIES
+
+////////////////////////////////////////
+void putQuery(string& out, const ShardQuery& query)
+{
+  putU8(out, query.type);
+  putU32(out, query.num);
+  putU32(out, query.tokens.size());
+  for (size_t i = 0; i != query.tokens.size(); ++i)
+    putString(out, query.tokens[i]);
+}
+
+////////////////////////////////////////
+// false if the message is broken
+bool getQuery(MessageReader& in, ShardQuery& query)
+{
+  uint8_t type;
+  uint32_t tokens;
+  if (!in.getU8(type) || type > QUERY_COUNT || !in.getU32(query.num) ||
+      !in.getU32(tokens))
+    return false;
+
+  // grown one at a time so a broken count can't allocate too much
+  query.type = static_cast<QueryType>(type);
+  query.tokens.clear();
+  string token;
+  for (size_t i = 0; i != tokens; ++i)
+    {
+      if (!in.getString(token))
+	return false;
+      query.tokens.push_back(token);
+    }
+  return true;
+}
+
+////////////////////////////////////////
+void putAnswer(string& out, const QueryType& type, const ShardAnswer& answer)
+{
+  if (type == QUERY_COUNT)
+    {
+      putU64(out, answer.count);
+      return;
+    }
+
+  putU32(out, answer.words.size());
+  for (size_t i = 0; i != answer.words.size(); ++i)
+    putString(out, answer.words[i]);
+}
+
+////////////////////////////////////////
+bool getAnswer(MessageReader& in, const QueryType& type, ShardAnswer& answer)
+{
+  answer.count = 0;
+  answer.words.clear();
+  if (type == QUERY_COUNT)
+    return in.getU64(answer.count);
+
+  uint32_t words;
+  if (!in.getU32(words))
+    return false;
+  string word;
+  for (size_t i = 0; i != words; ++i)
+    {
+      if (!in.getString(word))
+	return false;
+      answer.words.push_back(word);
+    }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// SOCKETS
+
+////////////////////////////////////////
+// false if the peer went away
+bool sendAll(const int& fd, const char* data, size_t size)
+{
+  while (size != 0)
+    {
+      const ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+      if (sent < 0 && errno == EINTR)
+	continue;
+      if (sent <= 0)
+	return false;
+      data += sent;
+      size -= sent;
+    }
+
+  return true;
+}
+
+////////////////////////////////////////
+bool recvAll(const int& fd, char* data, size_t size)
+{
+  while (size != 0)
+    {
+      const ssize_t got = recv(fd, data, size, 0);
+      if (got < 0 && errno == EINTR)
+	continue;
+      if (got <= 0)
+	return false;
+      data += got;
+      size -= got;
+    }
+
+  return true;
+}
+
+////////////////////////////////////////
+bool sendMessage(const int& fd, const string& message)
+{
+  string length;
+  putU32(length, message.size());
+  return sendAll(fd, length.data(), 4) &&
+         sendAll(fd, message.data(), message.size());
+}
+
+////////////////////////////////////////
+bool recvMessage(const int& fd, string& message)
+{
+  string length(4, '\0');
+  uint32_t size;
+  if (!recvAll(fd, &length[0], 4) || !MessageReader(length).getU32(size) ||
+      size > MAX_MESSAGE)
+    return false;
+
+  message.resize(size);
+  return recvAll(fd, &message[0], size);
+}
+
+////////////////////////////////////////
+// address of the socket at path, false if the path is too long
+bool socketAddress(const string& path, sockaddr_un& address)
+{
+  address = sockaddr_un();
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path))
+    return false;
+
+  path.copy(address.sun_path, path.size());
+  return true;
+}
+
+#endif // SHARD_H
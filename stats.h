@@ -0,0 +1,73 @@
+#ifndef STATS_H
+#define STATS_H
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// FILE:        stats.h
+// DESCRIPTION: counters on the query hot paths, compiled in with
+//              -DNGRAM_STATS and compiled out to nothing otherwise
+// AUTHOR:      Dan Fabian and Lauren Greathouse
+// DATE:        10/18/2026
+
+#include <stdint.h>
+#include <iostream>
+
+using std::ostream;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// QUERY STATS
+
+struct QueryStats {
+  QueryStats() { reset(); }
+
+  void reset ();
+  void print (ostream&) const;
+
+  uint64_t lookups;        // contexts looked up by Trie queries
+  uint64_t depth;          // Nodes those lookups went through
+  uint64_t selects;        // Encoder upper bit searches, from access or decode
+  uint64_t bitsScanned;    // upper bits they read
+  uint64_t hashGets;       // HashmapEF::getID
+  uint64_t hashProbes;     // slots they looked at
+  uint64_t successorFinds; // Node::findSuccessor
+  uint64_t topKHits;       // of them, answered by topK_
+  uint64_t vocabLookups;   // words hashed to their IDs
+};
+
+QueryStats QUERY_STATS; // Keeps count while NGRAM_STATS is defined
+
+// the arguments aren't evaluated when the counters are compiled out
+#ifdef NGRAM_STATS
+#define COUNT_STAT(counter, n) (QUERY_STATS.counter += (n))
+#else
+#define COUNT_STAT(counter, n) ((void)0)
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// QUERY STATS member functions
+////////////////////////////////////////
+void QueryStats::reset()
+{
+  lookups = depth = 0;
+  selects = bitsScanned = 0;
+  hashGets = hashProbes = 0;
+  successorFinds = topKHits = 0;
+  vocabLookups = 0;
+}
+
+////////////////////////////////////////
+void QueryStats::print(ostream& out) const
+{
+  // ratios of counters that were never hit print as 0
+  auto ratio = [](uint64_t a, uint64_t b) { return b == 0 ? 0 : double(a) / b; };
+
+  out << "depth/lookup " << ratio(depth, lookups) << ", "
+      << "bits scanned/select " << ratio(bitsScanned, selects) << ", "
+      << "probes/HashmapEF get " << ratio(hashProbes, hashGets) << ", "
+      << "top K hit rate " << ratio(topKHits, successorFinds) << ", "
+      << "vocab lookups/lookup " << ratio(vocabLookups, lookups) << '\n';
+}
+
+#endif // STATS_H
@@ -9,17 +9,121 @@
 // DATE:        4/19/2019
 
 #include "node.h"
+#include "options.h"
+#include "arena.h"
+#include "reader.h"
 #include <string>
 #include <utility>
 #include <cassert>
 #include <vector>
-#include <sstream>
+#include <deque>
+#include <queue>
+#include <functional>
+#include <unordered_map>
+#include <map>
+#include <algorithm>
+#include <thread>
 
-using std::istream; using std::getline; 
-using std::string; using std::stoi;
+using std::istream;
+using std::string;
 using std::pair; using std::make_pair;
 using std::vector;
-using std::stringstream;
+using std::deque;
+using std::priority_queue; using std::greater;
+using std::unordered_map; using std::map;
+using std::lower_bound; using std::upper_bound; using std::remove_if;
+using std::inplace_merge;
+using std::thread;
+
+// matches any word in a pattern query
+const string WILDCARD = "*";
+
+// successor tables with at least this many Nodes get a CompletionIndex,
+// completeNext scans the smaller ones whole
+const size_t COMPLETION_INDEX_MIN = 64;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// TRIE BUILDER
+//
+// builds the Nodes from grams given in sorted order. The path from a root to
+// the last gram added is kept on a stack, a Node is only made once every
+// gram under it has been added, when the next gram leaves its subtree.
+//
+// Pruning, see TrieOptions, happens before the Nodes are made. A Node's 
+// successors wait as Pending until it is closed, then the ones that are kept
+// get Nodes. A gram below its order's minimum count is known to be dropped
+// as soon as a longer gram under it arrives, so nothing under it is built.
+//
+// With TrieOptions::dedup a Node whose successors are identical to an
+// earlier Node's, the same words with the same counts and the same 
+// structures under them, shares that Node's SortedEF and HashmapEF. The 
+// successors are built bottom up so identical subtrees already share their
+// structures, comparing the structure pointers one level down is enough
+
+struct BuildStats {
+  BuildStats() : dropped(0), droppedBytes(0), successorSets(0), shared(0),
+		 sharedBytes(0) {}
+
+  size_t dropped;       // grams pruned, counting every gram under a pruned one
+  size_t droppedBytes;  // at least this many bytes of Nodes weren't kept
+  size_t successorSets; // Nodes with successors
+  size_t shared;        // of them, using another Node's structures
+  size_t sharedBytes;   // freed by sharing
+};
+
+class TrieBuilder {
+public:
+  // unigram is the count of each ID, needed for entropy pruning
+  TrieBuilder(const int& k, const TrieOptions& options,
+	      const vector<size_t>& unigram = vector<size_t>());
+  ~TrieBuilder();
+
+  // methods
+  void              add    (const vector<uint32_t>&, const size_t&);
+  HashmapEF*        finish (); // returns the roots
+  const BuildStats& stats  () const { return stats_; }
+
+private:
+  struct Pending {
+    uint32_t gram;
+    size_t freq;
+    vector<Node*> successors;
+  };
+
+  struct Level {
+    uint32_t gram;
+    size_t count;   // from the gram's own lines
+    bool counted;   // if the gram had a line
+    bool dropped;   // if it and everything under it is pruned
+    vector<Pending> successors;
+  };
+
+  // successor structures that can be shared, and the key they are found by
+  struct Shared {
+    int k;
+    SortedEF *topK;
+    HashmapEF *successors;
+  };
+  struct KeyHash {
+    size_t operator()(const vector<uint64_t>&) const;
+  };
+
+  void  close   (const size_t&); // makes the Nodes deeper than the depth
+  void  prune   (vector<Pending>&, const size_t&);
+  void  drop    (const Pending&);
+  Node* makeNode(const Pending&);
+  void  dedup   (Node*);
+
+  int k_;
+  TrieOptions options_;
+  vector<size_t> unigram_;
+  double total_; // sum of unigram_
+  vector<Level> path_;
+  vector<Pending> roots_;
+  BuildStats stats_;
+  unordered_map<vector<uint64_t>, Shared, KeyHash> shared_;
+};
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -28,133 +132,1097 @@ using std::stringstream;
 class Trie {
 public:
   // constructor
-  Trie(istream&, const int&, const int&); // pass istream to file where data is 
-  ~Trie() { SIZE_TRACKER -= sizeof(*this); delete roots_; }
+  Trie(istream&, const int&, const int&,  // pass istream to file where data is
+       const TrieOptions& = TrieOptions());
+  Trie(GramReader&, const int&,           // or a reader of it
+       const TrieOptions& = TrieOptions());
+  ~Trie();
 
   // methods or queries
-  vector<string> mostLikelyNext (const vector<string>&, const int&) const;
-  size_t         frequencyCount (const vector<string>&)             const;
+  vector<string> mostLikelyNext     (const vector<string>&, const int&) const;
+  vector<string> mostLikelyPrevious (const vector<string>&, const int&) const;
+  size_t         frequencyCount     (const vector<string>&,
+				     const Direction& = FORWARD)        const;
+
+  // the same without copying words, the top num successors are written to
+  // out and how many were is returned, EncoderBase::word gives their words
+  size_t mostLikelyNext     (const vector<string>&, const size_t&,
+			     Successor*) const;
+  size_t mostLikelyPrevious (const vector<string>&, const size_t&,
+			     Successor*) const;
+
+  // pattern queries, WILDCARD matches any word
+  typedef pair<vector<string>, size_t> Match; // gram and its count
+  vector<Match>  topMatches   (const vector<string>&, const size_t&,
+			       const Direction& = FORWARD) const;
+  size_t         patternCount (const vector<string>&,
+			       const Direction& = FORWARD) const;
+
+  // top num words starting with prefix that follow the context, an empty
+  // context completes the first word. The Successor version writes them to
+  // out and returns how many it wrote, like mostLikelyNext
+  vector<string> completeNext (const vector<string>&, const string&,
+			       const int&) const;
+  size_t         completeNext (const vector<string>&, const string&,
+			       const size_t&, Successor*) const;
+
+  size_t arenaBytes () const { return arena_ == nullptr ? 0 : arena_->bytes(); }
+
+  // part of SIZE_TRACKER that is the backward trie, 0 if it wasn't built
+  size_t backwardBytes () const { return backwardBytes_; }
+
+  // what pruning dropped and dedup shared, from both tries if there is a
+  // backward one
+  const BuildStats& buildStats () const { return stats_; }
 
 private:
+  typedef pair<Node*, Node*> NodePair; // old Node and where it was moved
+  typedef vector<pair<vector<uint32_t>, size_t>> IDGrams; // and counts
+
+  void             ingest    (GramReader&, const int&);
+  static void      sortGrams (IDGrams&);
+  HashmapEF*       build     (IDGrams&, const int&, const TrieOptions&);
+
+  HashmapEF*       layout   (HashmapEF*, const Layout&);
+  vector<NodePair> place    (const NodePair&);
+  void             placeHot (const NodePair&);
+  vector<NodePair> placeVEB (const vector<NodePair>&, const int&);
+
+  Node* find (const HashmapEF*, const vector<string>&, const Direction&) const;
+
+  typedef pair<size_t, vector<uint32_t>> Found; // count and gram IDs
+  struct Matches {
+    size_t limit; // most kept, 0 to only sum the counts
+    size_t total;
+    priority_queue<Found, vector<Found>, greater<Found>> best; // least on top
+  };
+
+  static size_t candidates (const Node*, const string&, vector<Node*>&);
+  void          match      (const vector<Node*>&, const size_t&,
+			    const vector<string>&, const Direction&,
+			    vector<uint32_t>&, Matches&) const;
+  Matches       search     (const vector<string>&, const size_t&,
+			    const Direction&) const;
+
+  // the successors of a context in lexicographic order with their
+  // frequencies, the words starting with a prefix are a slice of them
+  struct CompletionIndex {
+    PackedArray *ranks; // lexRank_ of each successor, ascending
+    PackedArray *freqs;
+  };
+
+  void                     sortVocab        ();
+  pair<uint32_t, uint32_t> prefixRange      (const string&) const;
+  void                     indexCompletions ();
+  void                     addCompletions   (const HashmapEF*,
+					     const vector<Node*>&);
+  pair<size_t, size_t>     completionSlice  (const CompletionIndex&,
+					     const pair<uint32_t, uint32_t>&)
+                                                                    const;
+  size_t                   completeIndexed  (const CompletionIndex&,
+					     const pair<size_t, size_t>&,
+					     const size_t&, Successor*) const;
+
   HashmapEF *roots_;
+  HashmapEF *backRoots_; // roots of the backward trie, nullptr unless 
+                         // options_.backward is set
+  size_t backwardBytes_;
+  Arena *arena_; // holds the Nodes when they have been laid out
+  int gramLen_;
+  TrieOptions options_;
+
+  // vocab IDs in lexicographic order of their words, and the position of
+  // each ID in it, so the words starting with a prefix are a range
+  vector<uint32_t> lexOrder_;
+  vector<uint32_t> lexRank_;
 
+  BuildStats stats_;
+
+  // during layout, the moved Node that got each shared pair of structures
+  map<pair<const SortedEF*, const HashmapEF*>, Node*> placed_;
+
+  // by the successors_ table of the context, roots_ for the first word.
+  // Only the forward trie and tables of at least COMPLETION_INDEX_MIN
+  unordered_map<const HashmapEF*, CompletionIndex> completions_;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// TRIE member functions
+// TRIE BUILDER member functions
 ////////////////////////////////////////
-Trie::Trie(istream& inFile, const int& gramLen, const int& k)
+TrieBuilder::TrieBuilder(const int& k, const TrieOptions& options,
+			 const vector<size_t>& unigram)
+: k_(k), options_(options), unigram_(unigram), total_(0)
 {
-  vector<vector<Node*>> levelNodes(gramLen);
-  vector<int> levelCounts(gramLen - 1, 0);
+  for (size_t i = 0; i != unigram_.size(); ++i)
+    total_ += unigram_[i];
+}
 
-  string word;
-  int previousSimilarCount;
-  vector<pair<vector<string>, int>> storedLines;
-  while(true)
-    {      
-      // seperate lines into vec of words the back of the context vec is 
-      // the leaf, and also store the count
-      pair<vector<string>, int> line;
-      for (int i = 0; i != gramLen + 1 && !inFile.eof(); ++i) // plus one to include the count
+////////////////////////////////////////
+// grams must come after the grams that start them, a gram added twice gets
+// the sum of its counts
+void TrieBuilder::add(const vector<uint32_t>& IDs, const size_t& count)
+{
+  size_t shared = 0;
+  while (shared != path_.size() && shared != IDs.size() &&
+	 path_[shared].gram == IDs[shared])
+    ++shared;
+  close(shared);
+
+  // the count of the gram this one extends is final now
+  if (shared != 0 && shared != IDs.size())
+    {
+      Level& parent = path_.back();
+      if (parent.counted && parent.count < options_.minCountFor(shared))
+	parent.dropped = true;
+    }
+
+  for (size_t i = shared; i != IDs.size(); ++i)
+    {
+      const bool dropped = !path_.empty() && path_.back().dropped;
+      Level level = { IDs[i], 0, false, dropped, vector<Pending>() };
+      path_.push_back(level);
+    }
+
+  path_.back().count += count;
+  path_.back().counted = true;
+}
+
+////////////////////////////////////////
+// a gram that only shows up as the start of longer grams gets the sum of the
+// ones that were kept, and is dropped if none were
+void TrieBuilder::close(const size_t& depth)
+{
+  while (path_.size() > depth)
+    {
+      Level& level = path_.back();
+      const size_t order = path_.size();
+      if (level.counted && level.count < options_.minCountFor(order))
+	level.dropped = true;
+
+      if (!level.dropped)
 	{
-	  inFile >> word;
-	  if (word == "") // possible if at the end of the file
-	    break;
-	    
-	  // if there is a tab then its not what we want in our vocab
-	  if (word.find('\t') == string::npos && i != gramLen)
-	    line.first.push_back(word);
-	  else
-	    line.second = stoi(word);
-	}      
+	  size_t total = 0;
+	  for (size_t i = 0; i != level.successors.size(); ++i)
+	    total += level.successors[i].freq;
+	  prune(level.successors, level.counted ? level.count : total);
+
+	  total = 0;
+	  for (size_t i = 0; i != level.successors.size(); ++i)
+	    total += level.successors[i].freq;
+	  if (!level.counted && 
+	      (total == 0 || total < options_.minCountFor(order)))
+	    level.dropped = true;
+	}
 
-      // once line has been read and parsed, create nodes
-      if (!storedLines.empty()) // if its the first line, skip this section
+      Pending node = { level.gram, level.count, vector<Node*>() };
+      if (level.dropped)
 	{
-	  // check similarities with previous line
-	  int similarCount = 0;
-	  pair<vector<string>, int> context = storedLines.back();
-	  bool diff = false;
-	  for (int i = 0; i != context.first.size() - 1 && !diff; ++i)
-	    {
-	      if (context.first[i] == line.first[i])
-		++similarCount;
-	      else
-		diff = true;
-	    }
+	  for (size_t i = 0; i != level.successors.size(); ++i)
+	    drop(level.successors[i]);
+	  drop(node);
+	  path_.pop_back();
+	  continue;
+	}
 
-	  // leaf case
-	  if (similarCount <= gramLen - 1 || levelNodes[gramLen - 1].empty() ||
-	      inFile.eof())
-	    {
-                  levelNodes[gramLen - 1].push_back
-                    (new Node((*Encoder::vocabS2ID_)[context.first[context.first.size() - 1]],
-                              context.second, k));
-                  levelCounts[gramLen - 2] += context.second;
-	    }
-	  // intermediate node cases
-	  for (int i = 2; i < gramLen; ++i)
-	    {
-	      if (similarCount <= gramLen - i || inFile.eof())
-		{
-		  levelNodes[gramLen - i].push_back
-		    (new Node((*Encoder::vocabS2ID_)[context.first[context.first.size() - i]],
-			      levelCounts[gramLen - i], k, levelNodes[gramLen - i + 1]));
-		  levelCounts[gramLen - i - 1] += levelCounts[gramLen - i];
-		  levelNodes[gramLen - i + 1].clear();
-		  levelCounts[gramLen - i] = 0;
-		}
-	    }
-	  // root case
-	  if (similarCount == 0 || inFile.eof()) 
+      for (size_t i = 0; i != level.successors.size(); ++i)
+	{
+	  node.successors.push_back(makeNode(level.successors[i]));
+	  if (!level.counted)
+	    node.freq += level.successors[i].freq;
+	}
+      path_.pop_back();
+
+      if (path_.empty())
+	roots_.push_back(node);
+      else
+	path_.back().successors.push_back(node);
+    }
+}
+
+////////////////////////////////////////
+// drops successors of a gram with frequency freq, first the ones that tell
+// little more than the unigram would then the least frequent past the most
+// a Node can have
+void TrieBuilder::prune(vector<Pending>& successors, const size_t& freq)
+{
+  // weighted difference of Seymore and Rosenfeld, a first order version of
+  // Stolcke's relative entropy pruning. p(h w) (log p(w | h) - log p(w)),
+  // the unigram standing in for the lower order the gram backs off to.
+  // Only grams nothing is kept under can go, the trie has to keep every
+  // gram that starts a kept one
+  if (options_.entropyThreshold > 0 && total_ != 0 && freq != 0)
+    {
+      vector<Pending> kept;
+      for (size_t i = 0; i != successors.size(); ++i)
+	{
+	  // without a unigram count there is nothing to back off to
+	  const Pending& s = successors[i];
+	  if (!s.successors.empty() || s.gram >= unigram_.size() ||
+	      unigram_[s.gram] == 0)
 	    {
-	      levelNodes[0].push_back
-		(new Node((*Encoder::vocabS2ID_)[context.first[0]],
-			  levelCounts[0], k, levelNodes[1]));
-	      levelCounts[0] = 0;
-	      levelNodes[1].clear();
+	      kept.push_back(s);
+	      continue;
 	    }
 
-	  // at the very last line just insert the root then return
-          if (inFile.eof())
-            {
-              roots_ = new HashmapEF(levelNodes[0]);
-	      
-	      // track size
-	      SIZE_TRACKER += sizeof(*this);
-              return;
-            }
-
-	  previousSimilarCount = similarCount;
+	  const double gain = s.freq / total_ * 
+	    log(double(s.freq) / freq / (unigram_[s.gram] / total_));
+	  if (gain < options_.entropyThreshold)
+	    drop(s);
+	  else
+	    kept.push_back(s);
 	}
+      successors.swap(kept);
+    }
 
-      // store line
-      storedLines.push_back(line);
+  if (options_.maxSuccessors != 0 && 
+      successors.size() > options_.maxSuccessors)
+    {
+      sort(successors.begin(), successors.end(), 
+	   [](const Pending& a, const Pending& b) { return a.freq > b.freq; });
+      for (size_t i = options_.maxSuccessors; i != successors.size(); ++i)
+	drop(successors[i]);
+      successors.resize(options_.maxSuccessors);
     }
 }
 
+////////////////////////////////////////
+// counts the gram and everything already built under it as dropped, then 
+// frees what was built
+void TrieBuilder::drop(const Pending& gram)
+{
+  ++stats_.dropped;
+  stats_.droppedBytes += sizeof(Node);
+
+  vector<Node*> below(gram.successors);
+  for (size_t i = 0; i != below.size(); ++i)
+    below[i]->getSuccessors(below);
+  stats_.dropped += below.size();
+
+  const size_t before = SIZE_TRACKER;
+  for (size_t i = 0; i != gram.successors.size(); ++i)
+    delete gram.successors[i];
+  stats_.droppedBytes += before - SIZE_TRACKER;
+}
+
+////////////////////////////////////////
+Node* TrieBuilder::makeNode(const Pending& gram)
+{
+  if (gram.successors.empty()) // leaf
+    return new Node(gram.gram, gram.freq);
+
+  Node *node = new Node(gram.gram, gram.freq, k_, gram.successors, options_);
+  if (options_.dedup)
+    dedup(node);
+  return node;
+}
+
+////////////////////////////////////////
+// the structures are built first, hashing what they hold, then dropped if
+// an earlier Node has the same. The key is the top K size followed by the
+// word, count and structures of each successor, in word order
+void TrieBuilder::dedup(Node* node)
+{
+  ++stats_.successorSets;
+
+  vector<Node*> successors;
+  node->getSuccessors(successors);
+  sort(successors.begin(), successors.end(), 
+       [](Node* a, Node* b) { return a->gram_ < b->gram_; });
+
+  vector<uint64_t> key(1, node->k_);
+  for (size_t i = 0; i != successors.size(); ++i)
+    {
+      key.push_back(successors[i]->gram_);
+      key.push_back(successors[i]->frequency_);
+      key.push_back(reinterpret_cast<uint64_t>(successors[i]->topK_));
+      key.push_back(reinterpret_cast<uint64_t>(successors[i]->successors_));
+    }
+
+  auto found = shared_.find(key);
+  if (found == shared_.end())
+    {
+      // the map keeps its own reference so the structures outlive node if
+      // it is pruned
+      Shared structures = { node->k_, node->topK_, node->successors_ };
+      if (structures.topK != nullptr)
+	structures.topK->share();
+      if (structures.successors != nullptr)
+	structures.successors->share();
+      shared_[key] = structures;
+      return;
+    }
+
+  const size_t before = SIZE_TRACKER;
+  node->share(found->second.k, found->second.topK, found->second.successors);
+  ++stats_.shared;
+  stats_.sharedBytes += before - SIZE_TRACKER;
+}
+
+////////////////////////////////////////
+size_t TrieBuilder::KeyHash::operator()(const vector<uint64_t>& key) const
+{
+  uint64_t hash = key.size();
+  for (size_t i = 0; i != key.size(); ++i)
+    hash = (hash ^ key[i]) * 0x9E3779B97F4A7C15 + (hash >> 29);
+  return hash;
+}
+
+////////////////////////////////////////
+// gives back the references held by shared_
+TrieBuilder::~TrieBuilder()
+{
+  for (auto& e: shared_)
+    {
+      if (e.second.topK != nullptr && e.second.topK->release())
+	delete e.second.topK;
+      if (e.second.successors != nullptr && e.second.successors->release())
+	delete e.second.successors;
+    }
+}
+
+////////////////////////////////////////
+HashmapEF* TrieBuilder::finish()
+{
+  close(0);
+
+  vector<Node*> roots;
+  for (size_t i = 0; i != roots_.size(); ++i)
+    roots.push_back(makeNode(roots_[i]));
+  roots_.clear();
+
+  return new HashmapEF(roots);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// TRIE member functions
+////////////////////////////////////////
+// lines can be any length up to gramLen and in any order, see GramReader.
+// A gram that has its own line gets that count, one that only shows up as
+// the start of longer grams gets the sum of their counts
+Trie::Trie(istream& inFile, const int& gramLen, const int& k,
+	   const TrieOptions& options)
+: roots_(nullptr), backRoots_(nullptr), backwardBytes_(0), arena_(nullptr),
+  gramLen_(gramLen), options_(options)
+{
+  GramReader reader(inFile, gramLen);
+  ingest(reader, k);
+}
+
+////////////////////////////////////////
+// sorts pieces of grams on their own threads, then merges them pairwise,
+// the merges of each round also on their own threads
+void Trie::sortGrams(IDGrams& grams)
+{
+  const size_t cores = thread::hardware_concurrency();
+  const size_t pieces = grams.size() < (1 << 16) || cores < 2 ? 1 : cores;
+
+  vector<IDGrams::iterator> bounds;
+  for (size_t i = 0; i != pieces; ++i)
+    bounds.push_back(grams.begin() + grams.size() * i / pieces);
+  bounds.push_back(grams.end());
+
+  vector<thread> workers;
+  for (size_t i = 0; i != pieces; ++i)
+    workers.push_back(thread([&bounds, i]
+			     { sort(bounds[i], bounds[i + 1]); }));
+  for (size_t i = 0; i != workers.size(); ++i)
+    workers[i].join();
+
+  for (size_t width = 1; width < pieces; width *= 2)
+    {
+      workers.clear();
+      for (size_t i = 0; i + width < pieces; i += 2 * width)
+	{
+	  const size_t end = i + 2 * width < pieces ? i + 2 * width : pieces;
+	  workers.push_back(thread([&bounds, i, width, end]
+				   { inplace_merge(bounds[i], bounds[i + width],
+						   bounds[end]); }));
+	}
+      for (size_t i = 0; i != workers.size(); ++i)
+	workers[i].join();
+    }
+}
+
+////////////////////////////////////////
+// gramLen is the reader's maxLen
+Trie::Trie(GramReader& reader, const int& k, const TrieOptions& options)
+: roots_(nullptr), backRoots_(nullptr), backwardBytes_(0), arena_(nullptr), 
+  gramLen_(reader.maxLen()), options_(options)
+{
+  ingest(reader, k);
+}
+
+////////////////////////////////////////
+void Trie::ingest(GramReader& reader, const int& k)
+{
+  const TrieOptions& options = options_;
+
+  // every gram as IDs, sorted so each gram comes right before the grams
+  // it starts. The backward trie gets the same grams reversed from the same
+  // read of the file
+  IDGrams grams, backGrams;
+  vector<string> tokens;
+  size_t count;
+  while (reader.next(tokens, count))
+    {
+      vector<uint32_t> IDs(tokens.size());
+      for (size_t i = 0; i != tokens.size(); ++i)
+	IDs[i] = EncoderBase::vocabS2ID_->at(tokens[i]);
+      grams.push_back(make_pair(IDs, count));
+      if (options.backward)
+	backGrams.push_back(make_pair(vector<uint32_t>(IDs.rbegin(), 
+						       IDs.rend()), count));
+    }
+
+  sortVocab();
+  roots_ = build(grams, k, options);
+  roots_ = layout(roots_, options.layout);
+  indexCompletions();
+  if (options.backward)
+    {
+      const size_t before = SIZE_TRACKER;
+      backRoots_ = build(backGrams, k, options);
+      backRoots_ = layout(backRoots_, options.layout);
+      backwardBytes_ = SIZE_TRACKER - before;
+    }
+
+  // track size
+  SIZE_TRACKER += sizeof(*this);
+}
+
+////////////////////////////////////////
+Trie::~Trie()
+{
+  SIZE_TRACKER -= sizeof(*this);
+  SIZE_TRACKER -= (lexOrder_.size() + lexRank_.size()) * sizeof(uint32_t);
+
+  for (auto& index: completions_)
+    {
+      delete index.second.ranks;
+      delete index.second.freqs;
+    }
+
+  delete roots_;
+  delete backRoots_;
+  delete arena_;
+}
+
+////////////////////////////////////////
+void Trie::sortVocab()
+{
+  // IDs below the first one have no word
+  const vector<string_view>& words = *EncoderBase::vocabWords_;
+  for (size_t ID = 0; ID != words.size(); ++ID)
+    if (!words[ID].empty())
+      lexOrder_.push_back(ID);
+  sort(lexOrder_.begin(), lexOrder_.end(), 
+       [&words](uint32_t a, uint32_t b) { return words[a] < words[b]; });
+
+  lexRank_.assign(words.size(), 0);
+  for (size_t i = 0; i != lexOrder_.size(); ++i)
+    lexRank_[lexOrder_[i]] = i;
+
+  SIZE_TRACKER += (lexOrder_.size() + lexRank_.size()) * sizeof(uint32_t);
+}
+
+////////////////////////////////////////
+// sorts the grams and builds a trie from them, returns its roots. Clears 
+// grams to give back their memory before the next trie is built
+HashmapEF* Trie::build(IDGrams& grams, const int& k, 
+		       const TrieOptions& options)
+{
+  sortGrams(grams);
+
+  // how often each ID is in a gram, at any position since fixed order
+  // input has words that never end one, what entropy pruning backs off to
+  vector<size_t> unigram;
+  if (options.entropyThreshold > 0)
+    for (size_t i = 0; i != grams.size(); ++i)
+      for (size_t j = 0; j != grams[i].first.size(); ++j)
+	{
+	  const uint32_t ID = grams[i].first[j];
+	  if (ID >= unigram.size())
+	    unigram.resize(ID + 1, 0);
+	  unigram[ID] += grams[i].second;
+	}
+
+  TrieBuilder builder(k, options, unigram);
+  for (size_t i = 0; i != grams.size(); ++i)
+    builder.add(grams[i].first, grams[i].second);
+  IDGrams().swap(grams);
+
+  HashmapEF *roots = builder.finish();
+  stats_.dropped += builder.stats().dropped;
+  stats_.droppedBytes += builder.stats().droppedBytes;
+  stats_.successorSets += builder.stats().successorSets;
+  stats_.shared += builder.stats().shared;
+  stats_.sharedBytes += builder.stats().sharedBytes;
+  return roots;
+}
+
+////////////////////////////////////////
+// moves every Node under roots into arena_ in the order given by how, each Node's
+// successors are allocated together, followed by its SortedEF, HashmapEF and
+// their bit arrays, so a lookup reads memory that is close together. 
+// Returns the table of the moved roots, table is deleted
+HashmapEF* Trie::layout(HashmapEF* table, const Layout& how)
+{
+  if (how == LAYOUT_BUILD)
+    return table;
+
+  vector<Node*> oldRoots;
+  table->getNodes(oldRoots);
+  sort(oldRoots.begin(), oldRoots.end(), 
+       [](Node* a, Node* b) { return *b < *a; });
+
+  // the backward trie goes in the same arena, after the forward one
+  if (arena_ == nullptr)
+    arena_ = new Arena;
+  Arena::current_ = arena_;
+
+  // roots first, then the table pointing to them
+  vector<NodePair> roots;
+  vector<Node*> newRoots;
+  for (size_t i = 0; i != oldRoots.size(); ++i)
+    {
+      newRoots.push_back(new Node(oldRoots[i]->getGramID(),
+				  oldRoots[i]->getFreq()));
+      roots.push_back(make_pair(oldRoots[i], newRoots.back()));
+    }
+  HashmapEF *newTable = new HashmapEF(newRoots);
+
+  if (how == LAYOUT_BFS)
+    {
+      deque<NodePair> queue(roots.begin(), roots.end());
+      while (!queue.empty())
+	{
+	  vector<NodePair> next = place(queue.front());
+	  queue.pop_front();
+	  queue.insert(queue.end(), next.begin(), next.end());
+	}
+    }
+  else if (how == LAYOUT_HOT)
+    for (size_t i = 0; i != roots.size(); ++i)
+      placeHot(roots[i]);
+  else
+    placeVEB(roots, gramLen_);
+
+  Arena::current_ = nullptr;
+  placed_.clear();
+
+  // old Nodes came from the heap
+  delete table;
+  return newTable;
+}
+
+////////////////////////////////////////
+// allocates the successors of the moved Node together then builds its
+// successor structures, returns the successors most frequent first
+vector<Trie::NodePair> Trie::place(const NodePair& nodes)
+{
+  // successors shared by dedup are moved once, later Nodes sharing them
+  // share the moved ones
+  const Node *old = nodes.first;
+  const pair<const SortedEF*, const HashmapEF*> key(old->topK_, 
+						    old->successors_);
+  if (options_.dedup && (old->topK_ != nullptr || old->successors_ != nullptr))
+    {
+      auto found = placed_.find(key);
+      if (found != placed_.end())
+	{
+	  const Node *moved = found->second;
+	  nodes.second->share(moved->k_, moved->topK_, moved->successors_);
+	  return vector<NodePair>();
+	}
+      placed_[key] = nodes.second;
+    }
+
+  vector<Node*> oldSuccessors;
+  nodes.first->getSuccessors(oldSuccessors);
+  sort(oldSuccessors.begin(), oldSuccessors.end(), 
+       [](Node* a, Node* b) { return *b < *a; });
+
+  vector<NodePair> result;
+  vector<Node*> newSuccessors;
+  for (size_t i = 0; i != oldSuccessors.size(); ++i)
+    {
+      newSuccessors.push_back(new Node(oldSuccessors[i]->getGramID(),
+				       oldSuccessors[i]->getFreq()));
+      result.push_back(make_pair(oldSuccessors[i], newSuccessors.back()));
+    }
+
+  // keep the top K size chosen when the trie was built
+  TrieOptions fixedK = options_;
+  fixedK.topKCoverage = 0;
+  fixedK.topKMinFreq = 0;
+  nodes.second->setSuccessors(newSuccessors, nodes.first->getK(), fixedK);
+  return result;
+}
+
+////////////////////////////////////////
+// depth first, most frequent successor first
+void Trie::placeHot(const NodePair& nodes)
+{
+  vector<NodePair> successors = place(nodes);
+  for (size_t i = 0; i != successors.size(); ++i)
+    placeHot(successors[i]);
+}
+
+////////////////////////////////////////
+// places the subtrees under tops that are height levels tall, the top half of
+// the levels are placed first then each subtree below them, recursively.
+// returns the Nodes right below the placed levels
+vector<Trie::NodePair> Trie::placeVEB(const vector<NodePair>& tops, 
+				      const int& height)
+{
+  vector<NodePair> bottom;
+  if (height <= 1)
+    {
+      for (size_t i = 0; i != tops.size(); ++i)
+	{
+	  vector<NodePair> successors = place(tops[i]);
+	  bottom.insert(bottom.end(), successors.begin(), successors.end());
+	}
+      return bottom;
+    }
+
+  const int topHeight = height / 2;
+  vector<NodePair> middle = placeVEB(tops, topHeight);
+  for (size_t i = 0; i != middle.size(); ++i)
+    {
+      vector<NodePair> below = placeVEB(vector<NodePair>(1, middle[i]),
+					height - topHeight);
+      bottom.insert(bottom.end(), below.begin(), below.end());
+    }
+
+  return bottom;
+}
+
+////////////////////////////////////////
+// returns the Node at the end of tokens, nullptr if it isn't in the trie.
+// BACKWARD walks tokens from the last one down the backward trie
+Node* Trie::find(const HashmapEF* roots, const vector<string>& tokens,
+		 const Direction& direction) const
+{
+  if (roots == nullptr || tokens.empty())
+    return nullptr;
+
+  const size_t last = tokens.size() - 1;
+  Node* branch = roots->get(tokens[direction == FORWARD ? 0 : last]);
+  size_t i = 1;
+  for (; i != tokens.size() && branch != nullptr; ++i)
+    branch = 
+      branch->findSuccessor(tokens[direction == FORWARD ? i : last - i]);
+
+  COUNT_STAT(lookups, 1);
+  COUNT_STAT(depth, branch == nullptr ? i - 1 : i);
+
+  return branch;
+}
+
 ////////////////////////////////////////
 // returns the top num of successors of the context string
 vector<string> Trie::mostLikelyNext(const vector<string>& tokens, 
 				    const int& num) const
 {
-  Node* branch = roots_->get(tokens[0]);
-  for (int i = 1; i != tokens.size(); ++i)
-    branch = branch->findSuccessor(tokens[i]);
+  Node* branch = find(roots_, tokens, FORWARD);
+
+  // context isn't in the trie
+  if (branch == nullptr)
+    return vector<string>();
+
+  return branch->mostLikelyNext(num);
+}
+
+////////////////////////////////////////
+// returns the top num words that come right before the context string, 
+// empty if the backward trie wasn't built
+vector<string> Trie::mostLikelyPrevious(const vector<string>& tokens, 
+					const int& num) const
+{
+  Node* branch = find(backRoots_, tokens, BACKWARD);
+  if (branch == nullptr)
+    return vector<string>();
 
   return branch->mostLikelyNext(num);
 }
 
 ////////////////////////////////////////
-size_t Trie::frequencyCount(const vector<string>& tokens) const
+size_t Trie::mostLikelyNext(const vector<string>& tokens, const size_t& num,
+			    Successor* out) const
+{
+  Node* branch = find(roots_, tokens, FORWARD);
+  return branch == nullptr ? 0 : branch->mostLikelyNext(num, out);
+}
+
+////////////////////////////////////////
+size_t Trie::mostLikelyPrevious(const vector<string>& tokens, 
+				const size_t& num, Successor* out) const
+{
+  Node* branch = find(backRoots_, tokens, BACKWARD);
+  return branch == nullptr ? 0 : branch->mostLikelyNext(num, out);
+}
+
+////////////////////////////////////////
+// tokens are always in reading order. BACKWARD looks them up in the 
+// backward trie, where a gram without its own line counts every longer
+// gram it ends instead of every one it starts. Read from an ARPA file the
+// count is the joint probability of the gram times ARPA_SCALE, see 
+// GramFormat, the model's own estimates don't make a gram's probability at
+// most that of its suffix so BACKWARD can be off by that much
+size_t Trie::frequencyCount(const vector<string>& tokens, 
+			    const Direction& direction) const
+{
+  Node* branch = find(direction == FORWARD ? roots_ : backRoots_, tokens, 
+		      direction);
+
+  return branch == nullptr ? 0 : branch->getFreq();
+}
+
+////////////////////////////////////////
+// the num most frequent grams matching pattern, most frequent first. 
+// BACKWARD matches against the backward trie, see frequencyCount
+vector<Trie::Match> Trie::topMatches(const vector<string>& pattern, 
+				     const size_t& num, 
+				     const Direction& direction) const
+{
+  vector<Match> result;
+  if (num == 0)
+    return result;
+
+  Matches found = search(pattern, num, direction);
+  while (!found.best.empty())
+    {
+      const vector<uint32_t>& IDs = found.best.top().second;
+      vector<string> gram(IDs.size());
+      for (size_t i = 0; i != IDs.size(); ++i)
+	gram[direction == FORWARD ? i : IDs.size() - 1 - i] =
+	  string(EncoderBase::word(IDs[i]));
+
+      result.push_back(make_pair(gram, found.best.top().first));
+      found.best.pop();
+    }
+
+  reverse(result.begin(), result.end());
+  return result;
+}
+
+////////////////////////////////////////
+// sum of the counts of every gram matching pattern
+size_t Trie::patternCount(const vector<string>& pattern, 
+			  const Direction& direction) const
+{
+  return search(pattern, 0, direction).total;
+}
+
+////////////////////////////////////////
+// finds the grams matching pattern, keeping the limit most frequent
+Trie::Matches Trie::search(const vector<string>& pattern, 
+			   const size_t& limit, 
+			   const Direction& direction) const
+{
+  Matches found;
+  found.limit = limit;
+  found.total = 0;
+
+  const HashmapEF *roots = direction == FORWARD ? roots_ : backRoots_;
+  if (roots == nullptr || pattern.empty())
+    return found;
+
+  const string& first = direction == FORWARD ? pattern[0] : pattern.back();
+  vector<Node*> nodes;
+  if (first == WILDCARD)
+    roots->getNodes(nodes);
+  else if (Node *root = roots->get(first))
+    nodes.push_back(root);
+
+  vector<uint32_t> path;
+  match(nodes, 0, pattern, direction, path, found);
+  return found;
+}
+
+////////////////////////////////////////
+// appends the successors of parent matching token, returns how many of them
+// at the front are in decreasing order of frequency. Every one after those
+// is less frequent than all of them
+size_t Trie::candidates(const Node* parent, const string& token,
+			vector<Node*>& nodes)
+{
+  if (token != WILDCARD)
+    {
+      if (Node *successor = parent->findSuccessor(token))
+	nodes.push_back(successor);
+      return nodes.size();
+    }
+
+  // topK_ comes first and is sorted, the successors_ are decoded in slot
+  // order after it
+  parent->getSuccessors(nodes);
+  const size_t k = parent->getK();
+  return k < nodes.size() ? k : nodes.size();
+}
+
+////////////////////////////////////////
+// matches the rest of pattern under each of nodes, which are at depth
+// path.size(). The first sorted nodes are in decreasing order of frequency.
+// No gram is more frequent than the one it starts, so once the limit is
+// reached a Node no more frequent than the least kept match is skipped with
+// everything under it
+void Trie::match(const vector<Node*>& nodes, const size_t& sorted,
+		 const vector<string>& pattern, const Direction& direction,
+		 vector<uint32_t>& path, Matches& found) const
+{
+  const size_t depth = path.size();
+  for (size_t i = 0; i != nodes.size(); ++i)
+    {
+      const size_t freq = nodes[i]->getFreq();
+      if (found.limit != 0 && found.best.size() == found.limit &&
+	  freq <= found.best.top().first)
+	{
+	  if (i < sorted) // the rest are no more frequent
+	    break;
+	  continue;
+	}
+
+      path.push_back(nodes[i]->getGramID());
+      if (depth + 1 == pattern.size())
+	{
+	  found.total += freq;
+	  if (found.limit != 0)
+	    {
+	      found.best.push(make_pair(freq, path));
+	      if (found.best.size() > found.limit)
+		found.best.pop();
+	    }
+	}
+      else
+	{
+	  const string& token = direction == FORWARD ? 
+	    pattern[depth + 1] : pattern[pattern.size() - depth - 2];
+	  vector<Node*> next;
+	  const size_t nextSorted = candidates(nodes[i], token, next);
+	  match(next, nextSorted, pattern, direction, path, found);
+	}
+      path.pop_back();
+    }
+}
+
+////////////////////////////////////////
+// the range of lexOrder_ holding the words that start with prefix
+pair<uint32_t, uint32_t> Trie::prefixRange(const string& prefix) const
+{
+  const vector<string_view>& words = *EncoderBase::vocabWords_;
+  const size_t length = prefix.size();
+  auto first = lower_bound
+    (lexOrder_.begin(), lexOrder_.end(), prefix, 
+     [&](uint32_t ID, const string& p) 
+     { return words[ID].compare(0, length, p) < 0; });
+  auto last = upper_bound
+    (first, lexOrder_.end(), prefix, 
+     [&](const string& p, uint32_t ID) 
+     { return words[ID].compare(0, length, p) > 0; });
+
+  return make_pair(first - lexOrder_.begin(), last - lexOrder_.begin());
+}
+
+////////////////////////////////////////
+// builds a CompletionIndex for every large successor table of the forward
+// trie, after layout so the tables are the ones queries see. A shared table
+// has the same subtree under it every time, it is only walked once
+void Trie::indexCompletions()
+{
+  vector<Node*> nodes, successors;
+  roots_->getNodes(nodes);
+  addCompletions(roots_, nodes);
+  while (!nodes.empty())
+    {
+      const Node *n = nodes.back();
+      nodes.pop_back();
+      if (n->successors_ != nullptr && completions_.count(n->successors_) != 0)
+	continue;
+
+      successors.clear();
+      n->getSuccessors(successors);
+      if (n->successors_ != nullptr)
+	addCompletions(n->successors_, successors);
+      nodes.insert(nodes.end(), successors.begin(), successors.end());
+    }
+}
+
+////////////////////////////////////////
+// nodes are all of the successors of the context table belongs to, its
+// topK_ ones too
+void Trie::addCompletions(const HashmapEF* table, const vector<Node*>& nodes)
+{
+  if (nodes.size() < COMPLETION_INDEX_MIN)
+    return;
+
+  vector<pair<uint64_t, uint64_t>> byWord; // lexRank_ and frequency
+  uint64_t maxFreq = 1;
+  for (size_t i = 0; i != nodes.size(); ++i)
+    {
+      byWord.push_back(make_pair(lexRank_[nodes[i]->getGramID()], 
+				 nodes[i]->getFreq()));
+      maxFreq = nodes[i]->getFreq() > maxFreq ? nodes[i]->getFreq() : maxFreq;
+    }
+  sort(byWord.begin(), byWord.end());
+
+  vector<uint64_t> ranks(byWord.size()), freqs(byWord.size());
+  for (size_t i = 0; i != byWord.size(); ++i)
+    {
+      ranks[i] = byWord[i].first;
+      freqs[i] = byWord[i].second;
+    }
+
+  CompletionIndex& index = completions_[table];
+  index.ranks = new PackedArray(ranks, bits - __builtin_clzll(ranks.back() | 1));
+  index.freqs = new PackedArray(freqs, bits - __builtin_clzll(maxFreq));
+}
+
+////////////////////////////////////////
+// the positions in index of the successors with lexRank_ in range
+pair<size_t, size_t> Trie::completionSlice
+  (const CompletionIndex& index, const pair<uint32_t, uint32_t>& range) const
+{
+  const PackedArray& ranks = *index.ranks;
+  auto firstAtLeast = [&ranks](size_t from, const uint32_t& rank)
+    {
+      size_t to = ranks.size();
+      while (from < to)
+	{
+	  const size_t middle = from + (to - from) / 2;
+	  if (ranks.get(middle) < rank)
+	    from = middle + 1;
+	  else
+	    to = middle;
+	}
+      return from;
+    };
+  const size_t first = firstAtLeast(0, range.first);
+  return make_pair(first, firstAtLeast(first, range.second));
+}
+
+////////////////////////////////////////
+// keeps the num most frequent of the slice of index, ties go to the word
+// that comes first
+size_t Trie::completeIndexed(const CompletionIndex& index, 
+			     const pair<size_t, size_t>& slice,
+			     const size_t& num, Successor* out) const
+{
+  // frequency and the inverted rank, the least frequent and then the last
+  // word is on top to be replaced
+  typedef pair<uint64_t, uint32_t> Entry;
+  priority_queue<Entry, vector<Entry>, greater<Entry>> best;
+  for (size_t i = slice.first; i != slice.second; ++i)
+    {
+      const Entry entry(index.freqs->get(i), ~uint32_t(index.ranks->get(i)));
+      if (best.size() < num)
+	best.push(entry);
+      else if (best.top() < entry)
+	{
+	  best.pop();
+	  best.push(entry);
+	}
+    }
+
+  const size_t found = best.size();
+  for (size_t i = found; i-- != 0; best.pop())
+    {
+      out[i].gram = lexOrder_[~best.top().second];
+      out[i].frequency = best.top().first;
+    }
+  return found;
+}
+
+////////////////////////////////////////
+vector<string> Trie::completeNext(const vector<string>& tokens, 
+				  const string& prefix, const int& num) const
+{
+  vector<string> result;
+  if (num <= 0)
+    return result;
+
+  // no more words can be found than there are in the vocab
+  vector<Successor> found(size_t(num) < lexOrder_.size() ? num 
+			  : lexOrder_.size());
+  const size_t got = completeNext(tokens, prefix, found.size(), found.data());
+  for (size_t i = 0; i != got; ++i)
+    result.push_back(string(EncoderBase::word(found[i].gram)));
+  return result;
+}
+
+////////////////////////////////////////
+// topK_ is checked first, it holds the most frequent successors in order.
+// If it doesn't have num matches, contexts with a CompletionIndex only look
+// at the successors in the prefix's range. When that is most of them, or
+// the context is small, the rest come from one sequential decode of 
+// successors_ which is faster per successor
+size_t Trie::completeNext(const vector<string>& tokens, const string& prefix,
+			  const size_t& num, Successor* out) const
 {
-  Node* branch = roots_->get(tokens[0]);
-  for (int i = 1; i != tokens.size(); ++i)
-    branch = branch->findSuccessor(tokens[i]);
+  if (num == 0)
+    return 0;
+
+  const HashmapEF *table = roots_;
+  const SortedEF *topK = nullptr;
+  if (!tokens.empty())
+    {
+      Node *branch = find(roots_, tokens, FORWARD);
+      if (branch == nullptr)
+	return 0;
+      table = branch->successors_;
+      topK = branch->topK_;
+    }
 
-  return branch->getFreq();
+  const pair<uint32_t, uint32_t> range = prefixRange(prefix);
+  if (range.first == range.second)
+    return 0;
+  auto matches = [&](Node* n) 
+    { return lexRank_[n->getGramID()] >= range.first &&
+	     lexRank_[n->getGramID()] < range.second; };
+
+  vector<Node*> found;
+  if (topK != nullptr)
+    {
+      vector<Node*> nodes;
+      topK->getNodes(nodes);
+      for (size_t i = 0; i != nodes.size() && found.size() != num; ++i)
+	if (matches(nodes[i]))
+	  found.push_back(nodes[i]);
+    }
+
+  if (found.size() != num && table != nullptr)
+    {
+      auto index = completions_.find(table);
+      if (index != completions_.end())
+	{
+	  const pair<size_t, size_t> slice = 
+	    completionSlice(index->second, range);
+	  if (2 * (slice.second - slice.first) < index->second.ranks->size())
+	    return completeIndexed(index->second, slice, num, out);
+	}
+
+      vector<Node*> rest;
+      table->getNodes(rest);
+      rest.erase(remove_if(rest.begin(), rest.end(), 
+			   [&](Node* n) { return !matches(n); }),
+		 rest.end());
+
+      const size_t needed = num - found.size() < rest.size() ? 
+	num - found.size() : rest.size();
+      partial_sort(rest.begin(), rest.begin() + needed, rest.end(),
+		   [](Node* a, Node* b) { return *b < *a; });
+      found.insert(found.end(), rest.begin(), rest.begin() + needed);
+    }
+
+  for (size_t i = 0; i != found.size(); ++i)
+    {
+      out[i].gram = found[i]->getGramID();
+      out[i].frequency = found[i]->getFreq();
+    }
+  return found.size();
 }
 
 #endif // TRIE_H
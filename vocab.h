@@ -4,21 +4,23 @@
 ////////////////////////////////////////////////////////////////////////////////
 //
 // FILE:        vocab.h
-// DESCRIPTION: builds vocabID2S and vocabS2ID
+// DESCRIPTION: builds vocabS2ID and vocabWords
 // AUTHOR:      Dan Fabian and Lauren Greathouse
 // DATE:        4/19/2019
 
 #include <unordered_map>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <algorithm>
 #include <utility>
 #include "EF_encoder.h" // for SIZE_TRACKER
+#include "reader.h"
 
 using std::unordered_map;
 using std::istream; using std::getline;
-using std::string;
+using std::string; using std::string_view;
 using std::vector;
 using std::sort; using std::reverse;
 using std::pair; using std::make_pair;
@@ -30,40 +32,49 @@ using std::pair; using std::make_pair;
 class Vocab {
 public:
   Vocab(istream&, int);
+  Vocab(GramReader&);
   ~Vocab() 
-    { SIZE_TRACKER = SIZE_TRACKER - sizeof(vocabID2S) - sizeof(vocabS2ID); }
+    { SIZE_TRACKER = SIZE_TRACKER - sizeof(vocabS2ID) - sizeof(vocabWords); }
 
-  static unordered_map<size_t, string> vocabID2S;
   static unordered_map<string, size_t> vocabS2ID;
+  static vector<string_view> vocabWords; // each word at its ID, viewing 
+                                         // the key in vocabS2ID
+
+private:
+  void build (GramReader&);
 };
 
 // init static members
-unordered_map<size_t, string> Vocab::vocabID2S;
 unordered_map<string, size_t> Vocab::vocabS2ID;
+vector<string_view> Vocab::vocabWords;
 
 ////////////////////////////////////////////////////////////////////////////////
 //
 // VOCAB member functions
 ////////////////////////////////////////
 Vocab::Vocab(istream& inFile, int gramLen)
+{
+  GramReader reader(inFile, gramLen);
+  build(reader);
+}
+
+////////////////////////////////////////
+Vocab::Vocab(GramReader& reader)
+{
+  build(reader);
+}
+
+////////////////////////////////////////
+void Vocab::build(GramReader& reader)
 {
   // store each word and count how many times they occur so 
   // words that occur the most get the smallest IDs
   unordered_map<string, size_t> allWords;
-  string word;
-  while (!inFile.eof())
-    {
-      for (int i = 0; i != gramLen; ++i)
-	{
-	  inFile >> word;
-	  // if there is a tab then its not what we want in our vocab
-	  if (word.find('\t') == string::npos)
-	    ++allWords[word];
-	}
-      
-      // move to next line, ignore the counts
-      getline(inFile, word);
-    }
+  vector<string> tokens;
+  size_t count;
+  while (reader.next(tokens, count))
+    for (size_t i = 0; i != tokens.size(); ++i)
+      ++allWords[tokens[i]];
 
   // now put unordered_map into vector to be sorted
   vector<pair<string, size_t>> wordsToSort;
@@ -82,14 +93,17 @@ Vocab::Vocab(istream& inFile, int gramLen)
   size_t startNum = 3; // need this since EF Encoding won't work with
                        // integers of 2 or less
   for (size_t i = 0; i != wordsToSort.size(); ++i)
-    {
-      vocabID2S[startNum + i] = wordsToSort[i].first;
-      vocabS2ID[wordsToSort[i].first] = startNum + i;
-    }
+    vocabS2ID[wordsToSort[i].first] = startNum + i;
+
+  // the keys of an unordered_map stay where they are as it grows, so the
+  // views are only taken once it is done
+  vocabWords.assign(startNum + wordsToSort.size(), string_view());
+  for (const auto& e: vocabS2ID)
+    vocabWords[e.second] = e.first;
 
   // track size
-  SIZE_TRACKER += sizeof(vocabID2S);
   SIZE_TRACKER += sizeof(vocabS2ID);
+  SIZE_TRACKER += sizeof(vocabWords);
 }
 
 #endif // VOCAB_H